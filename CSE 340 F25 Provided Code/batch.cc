@@ -0,0 +1,136 @@
+/*
+ * Batch driver: runs many input programs through one process
+ */
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+#include "batch.h"
+#include "parser.h"
+
+using namespace std;
+
+enum BatchResult { BATCH_OK, BATCH_SYNTAX_ERROR, BATCH_SEMANTIC_ERROR, BATCH_IO_ERROR };
+
+static string output_path_for(const string& input_file, const string& output_dir)
+{
+    if (output_dir.empty()) {
+        return input_file + ".output";
+    }
+    string name = input_file;
+    size_t slash = name.find_last_of('/');
+    if (slash != string::npos) {
+        name = name.substr(slash + 1);
+    }
+    size_t dot = name.find_last_of('.');
+    if (dot != string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+    return output_dir + "/" + name + ".output";
+}
+
+// Absolute path with ".", ".." and symbolic links resolved (as far as the
+// path exists), so that aliases such as a.txt.output and ./a.txt.output
+// compare equal
+static string canonical_output_path(const string& path)
+{
+    error_code error;
+    filesystem::path absolute = filesystem::absolute(path, error);
+    if (error) {
+        return path;
+    }
+    filesystem::path canonical = filesystem::weakly_canonical(absolute, error);
+    return error ? absolute.lexically_normal().string() : canonical.string();
+}
+
+static BatchResult run_one(Parser& parser, const string& input_file, const string& output_dir)
+{
+    ifstream in(input_file);
+    if (!in) {
+        return BATCH_IO_ERROR;
+    }
+    ofstream out(output_path_for(input_file, output_dir));
+    if (!out) {
+        return BATCH_IO_ERROR;
+    }
+
+    parser.reset(in, out);
+    switch (parser.parse_program()) {
+        case PARSE_SYNTAX_ERROR:   return BATCH_SYNTAX_ERROR;
+        case PARSE_SEMANTIC_ERROR: return BATCH_SEMANTIC_ERROR;
+        default:                   return BATCH_OK;
+    }
+}
+
+static void batch_worker(const vector<string>& input_files, const string& output_dir,
+                         const ParserOptions& options, atomic<size_t>& next_file,
+                         vector<BatchResult>& results)
+{
+    // One parser per worker; it is reset for every program it handles
+    istringstream no_input;
+    Parser parser(no_input, cout);
+    parser.set_options(options);
+
+    for (size_t i = next_file++; i < input_files.size(); i = next_file++) {
+        results[i] = run_one(parser, input_files[i], output_dir);
+    }
+}
+
+int run_batch(const vector<string>& input_files, const string& output_dir, int jobs,
+              const ParserOptions& options)
+{
+    // Two programs writing the same output file would overwrite each other
+    // (or interleave when run by different workers): -o DIR keeps only the
+    // basename, so a/t1.txt and b/t1.txt collide, as does a file listed
+    // twice under any spelling of its path. Refuse the whole batch before
+    // anything is written.
+    unordered_map<string, size_t> output_owner;
+    bool collision = false;
+    for (size_t i = 0; i < input_files.size(); i++) {
+        string output_path = output_path_for(input_files[i], output_dir);
+        auto inserted = output_owner.emplace(canonical_output_path(output_path), i);
+        if (!inserted.second) {
+            cerr << input_files[inserted.first->second] << " and " << input_files[i]
+                 << " would both write " << output_path << endl;
+            collision = true;
+        }
+    }
+    if (collision) {
+        return 1;
+    }
+
+    if (jobs < 1) jobs = 1;
+    if (jobs > (int)input_files.size()) jobs = (int)input_files.size();
+
+    vector<BatchResult> results(input_files.size(), BATCH_OK);
+    atomic<size_t> next_file(0);
+
+    if (jobs <= 1) {
+        batch_worker(input_files, output_dir, options, next_file, results);
+    } else {
+        vector<thread> workers;
+        for (int i = 0; i < jobs; i++) {
+            workers.emplace_back(batch_worker, cref(input_files), cref(output_dir),
+                                 cref(options), ref(next_file), ref(results));
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    static const char* result_names[] = { "OK", "SYNTAX ERROR", "SEMANTIC ERROR", "CANNOT OPEN" };
+    int status = 0;
+    for (size_t i = 0; i < input_files.size(); i++) {
+        cerr << input_files[i] << ": " << result_names[results[i]] << endl;
+        if (results[i] != BATCH_OK) {
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,22 @@
+/*
+ * Batch driver: runs many input programs through one process
+ */
+#ifndef __BATCH__H__
+#define __BATCH__H__
+
+#include <string>
+#include <vector>
+
+#include "parser.h"
+
+// Parses and executes every file in input_files. The output of each program
+// goes to <output_dir>/<basename>.output, or to <file>.output when
+// output_dir is empty. If two files would get the same output path, both are
+// reported and nothing is run. Programs are distributed over `jobs` worker
+// threads, each of which reuses a single Parser. A one line status per
+// program is written to std::cerr in input order. Returns 0 if every program
+// ran without syntax or semantic errors, 1 otherwise.
+int run_batch(const std::vector<std::string>& input_files,
+              const std::string& output_dir, int jobs, const ParserOptions& options);
+
+#endif  //__BATCH__H__
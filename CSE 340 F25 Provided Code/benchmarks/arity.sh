@@ -0,0 +1,56 @@
+#!/bin/bash
+#
+# Arity-specialized evaluation: for declarations of 1 to 8 parameters (and
+# 10, which always uses the generic evaluator), time to run an EXECUTE
+# section of many calls with and without --no-arity-specialization. Both
+# runs use --no-cse-plans, as a plan is used instead of either evaluator.
+# The outputs of the two runs are compared. Run from the directory that
+# contains a.out:
+#
+#   ./benchmarks/arity.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+printf "%8s %10s %10s %12s %10s\n" arity output generic specialized speedup
+
+for arity in 1 2 3 4 5 6 7 8 10; do
+    # One declaration of 200 terms over `arity` parameters and 100000 calls
+    # chained through two variables
+    input=./bench_tmp/arity$arity.txt
+    awk -v n=$arity 'BEGIN {
+        print "TASKS 2";
+        print "POLY";
+        printf "F(";
+        for (k = 1; k <= n; k++) printf (k > 1 ? ", p%d" : "p%d"), k;
+        printf ") = ";
+        for (j = 1; j <= 200; j++) {
+            if (j > 1) printf (j % 3 ? " + " : " - ");
+            printf "%d", j;
+            for (k = 1; k <= n; k++) if ((j + k) % 3) printf " p%d^%d", k, (j * k) % 3 + 1;
+        }
+        print ";";
+        print "EXECUTE";
+        print "INPUT a;";
+        print "INPUT b;";
+        for (i = 1; i <= 50000; i++) {
+            printf "a = F(a";
+            for (k = 2; k <= n; k++) printf (k % 2 ? ", a" : ", b");
+            print ");";
+            printf "b = F(b";
+            for (k = 2; k <= n; k++) printf ", %d", i % 7 + k;
+            print ");";
+            if (i % 500 == 0) print "OUTPUT a;";
+        }
+        print "OUTPUT b;";
+        print "INPUTS 3 5";
+    }' > $input
+
+    ./a.out --no-cse-plans --no-arity-specialization < $input > ./bench_tmp/generic.out
+    ./a.out --no-cse-plans < $input > ./bench_tmp/specialized.out
+    if cmp -s ./bench_tmp/generic.out ./bench_tmp/specialized.out; then check=same; else check=DIFFERENT; fi
+    generic_time=$(best_seconds sh -c "./a.out --no-cse-plans --no-arity-specialization < $input")
+    time=$(best_seconds sh -c "./a.out --no-cse-plans < $input")
+    speedup=$(ratio $generic_time $time)
+    printf "%8s %10s %10s %12s %10s\n" $arity $check $generic_time $time $speedup
+done
@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Check-only mode: time to validate generated programs of growing size
+# with --check, against the full pipeline (Tasks 1-4) on the same program.
+# Throughput is in input megabytes per second. Run from the directory that
+# contains a.out:
+#
+#   ./benchmarks/check_only.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# DECLS declarations of 20 terms each, one statement per declaration and
+# as many inputs
+generate() {
+    awk -v n=$1 'BEGIN {
+        print "TASKS 1 2 3 4";
+        print "POLY";
+        for (i = 1; i <= n; i++) {
+            printf "F%d(x, y, z) = ", i;
+            for (j = 1; j <= 20; j++) {
+                if (j > 1) printf (j % 2 ? " + " : " - ");
+                printf "%d x^%d y z^%d", j, (i + j) % 7 + 1, j % 5 + 1;
+            }
+            printf " + (x + y)(y - z^2);\n";
+        }
+        print "EXECUTE";
+        print "INPUT a;";
+        for (i = 1; i <= n; i++) {
+            printf "a = F%d(a, %d, F%d(a, 1, 2));\n", i, i, (i % n) + 1;
+        }
+        print "OUTPUT a;";
+        print "INPUTS";
+        for (i = 1; i <= n; i++) printf "%d ", i;
+        print "";
+    }'
+}
+
+run() {
+    decls=$1
+    input=./bench_tmp/program${decls}.txt
+    generate $decls > $input
+    bytes=$(wc -c < $input)
+    full_time=$(seconds sh -c "./a.out < $input")
+    check_time=$(seconds sh -c "./a.out --check < $input")
+    # a valid program: nothing to report
+    if [ -z "$(./a.out --check < $input)" ]; then check=valid; else check=INVALID; fi
+    full_rate=$(awk -v b=$bytes -v s=$full_time 'BEGIN { printf "%.1f", (s > 0 ? b / 1048576 / s : 0) }')
+    check_rate=$(awk -v b=$bytes -v s=$check_time 'BEGIN { printf "%.1f", (s > 0 ? b / 1048576 / s : 0) }')
+    printf "%8s %10s %8s %10s %10s %10s %10s\n" $decls $bytes $check $full_time $check_time $full_rate $check_rate
+}
+
+printf "%8s %10s %8s %10s %10s %10s %10s\n" decls bytes program "full s" "check s" "full MB/s" "check MB/s"
+
+for decls in 1000 10000 50000; do
+    run $decls
+done
@@ -0,0 +1,44 @@
+#!/bin/bash
+#
+# Helpers shared by the benchmarks, which source this file and are run from
+# the directory that contains a.out:
+#
+#   . "$(dirname "$0")/common.sh"
+#
+# It stops if ./a.out is missing, creates ./bench_tmp for generated inputs
+# (removed when the benchmark exits) and defines
+#
+#   seconds CMD...        wall clock time of one run of CMD, output discarded
+#   best_seconds CMD...   the best of three runs
+#   ratio BASE TIME       BASE / TIME with two decimals (a speedup)
+#
+
+if [ ! -x "./a.out" ]; then
+    echo "Error: a.out not found!"
+    exit 1
+fi
+
+mkdir -p ./bench_tmp
+trap 'rm -rf ./bench_tmp' EXIT
+
+seconds() {
+    start=$(date +%s%N)
+    "$@" > /dev/null 2>&1
+    end=$(date +%s%N)
+    awk -v ns=$((end - start)) 'BEGIN { printf "%.3f", ns / 1e9 }'
+}
+
+best_seconds() {
+    best=0
+    for run in 1 2 3; do
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        end=$(date +%s%N)
+        if [ $best -eq 0 ] || [ $((end - start)) -lt $best ]; then best=$((end - start)); fi
+    done
+    awk -v ns=$best 'BEGIN { printf "%.3f", ns / 1e9 }'
+}
+
+ratio() {
+    awk -v a=$1 -v b=$2 'BEGIN { printf "%.2f", (b > 0 ? a / b : 0) }'
+}
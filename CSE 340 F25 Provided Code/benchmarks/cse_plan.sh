@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Evaluation plans: for declarations of 100 to 800 terms over four
+# parameters, with the shared prefixes and repeated powers of generated
+# bodies, the multiplications of one call of every declaration with and
+# without a plan (from --stats) and the time to run an EXECUTE section of
+# many calls with and without --no-cse-plans. The outputs of the two runs
+# are compared. Run from the directory that contains a.out:
+#
+#   ./benchmarks/cse_plan.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+printf "%8s %10s %10s %10s %10s %10s %10s\n" terms naive planned ratio output seconds speedup
+
+for terms in 100 200 400 800; do
+    # Two declarations of `terms` terms and 20000 calls chained through
+    # three variables
+    input=./bench_tmp/cse$terms.txt
+    awk -v n=$terms 'BEGIN {
+        print "TASKS 2";
+        print "POLY";
+        for (p = 1; p <= 2; p++) {
+            printf "F%d(x, y, z, w) = ", p;
+            for (j = 1; j <= n; j++) {
+                if (j > 1) printf (j % 3 ? " + " : " - ");
+                printf "%d x^%d y^%d z^%d w^%d", j % 17 + p, j % 4 + 1, (j / 4) % 3 + 1, (j / 12) % 5, j % 7 + 1;
+            }
+            print ";";
+        }
+        print "EXECUTE";
+        print "INPUT a;";
+        print "INPUT b;";
+        print "INPUT c;";
+        for (i = 1; i <= 10000; i++) {
+            print "a = F1(a, b, c, " i ");";
+            print "b = F2(b, c, a, " i ");";
+            if (i % 100 == 0) print "OUTPUT a;";
+        }
+        print "OUTPUT b;";
+        print "INPUTS 3 5 7";
+    }' > $input
+
+    counts=$(./a.out --stats < $input 2>&1 >/dev/null | sed -n 's/^stats: cse .* multiplications=\([0-9]*\) naive-multiplications=\([0-9]*\)$/\2 \1/p')
+    naive=${counts% *}
+    planned=${counts#* }
+    ratio=$(ratio $naive $planned)
+
+    ./a.out --no-cse-plans < $input > ./bench_tmp/naive.out
+    ./a.out < $input > ./bench_tmp/planned.out
+    if cmp -s ./bench_tmp/naive.out ./bench_tmp/planned.out; then check=same; else check=DIFFERENT; fi
+    naive_time=$(seconds sh -c "./a.out --no-cse-plans < $input")
+    time=$(seconds sh -c "./a.out < $input")
+    speedup=$(ratio $naive_time $time)
+    printf "%8s %10s %10s %10s %10s %10s %10s\n" $terms $naive $planned $ratio $check $time $speedup
+done
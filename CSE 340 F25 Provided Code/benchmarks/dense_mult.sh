@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Task 5 multiplication engines: time of schoolbook versus dense (Kronecker
+# substitution + Karatsuba) multiplication of two dense factors of growing
+# size, with a check that both engines print the same output. The auto
+# column shows which engine --mult auto picks. Run from the directory that
+# contains a.out:
+#
+#   ./benchmarks/dense_mult.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# dense_factor N C: sum of C * x^i y^j for 0 <= i, j < N, with varying C
+dense_factor() {
+    awk -v n=$1 -v c=$2 'BEGIN {
+        printf "(";
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < n; j++) {
+                if (i + j > 0) printf " + ";
+                printf "%d x^%d y^%d", (i * n + j) % 97 + c, i, j;
+            }
+        }
+        printf ")";
+    }'
+}
+
+run() {
+    n=$1
+    input=./bench_tmp/dense${n}.txt
+    printf "TASKS 5\nPOLY F(x,y) = %s%s;\nEXECUTE OUTPUT a;\nINPUTS 1\n" \
+        "$(dense_factor $n 1)" "$(dense_factor $n 2)" > $input
+    ./a.out --mult schoolbook < $input > ./bench_tmp/schoolbook.out
+    ./a.out --mult dense < $input > ./bench_tmp/dense.out
+    ./a.out --mult auto < $input > ./bench_tmp/auto.out
+    if cmp -s ./bench_tmp/schoolbook.out ./bench_tmp/dense.out; then check=same; else check=DIFFERENT; fi
+    if cmp -s ./bench_tmp/schoolbook.out ./bench_tmp/auto.out; then :; else check=DIFFERENT; fi
+    schoolbook_time=$(seconds sh -c "./a.out --mult schoolbook < $input")
+    dense_time=$(seconds sh -c "./a.out --mult dense < $input")
+    auto_time=$(seconds sh -c "./a.out --mult auto < $input")
+    printf "%6s %10s %12s %10s %10s\n" $((n * n)) $check $schoolbook_time $dense_time $auto_time
+}
+
+printf "%6s %10s %12s %10s %10s\n" terms output "schoolbook s" "dense s" "auto s"
+
+for n in 4 8 12 16 24 32 48; do
+    run $n
+done
@@ -0,0 +1,55 @@
+#!/bin/bash
+#
+# Task 5 expansion cache: hit rate, time saved and total time with and
+# without sharing the expansions of identical parenthesized terms, on a
+# corpus of declarations that reuse a few large sub-expressions. Run from
+# the directory that contains a.out:
+#
+#   ./benchmarks/expansion_cache.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# sum_factor VAR1 VAR2 N: (VAR1 VAR2 + VAR1^2 VAR2 + ... ) with N terms
+sum_factor() {
+    awk -v a=$1 -v b=$2 -v n=$3 'BEGIN {
+        printf "(";
+        for (i = 1; i <= n; i++) {
+            if (i > 1) printf " + ";
+            printf "%s^%d %s^%d", a, (i - 1) % 10 + 1, b, int((i - 1) / 10) + 1;
+        }
+        printf ")";
+    }'
+}
+
+# DECLS declarations over three shared products, used with different
+# signs, plus one unshared term
+run() {
+    decls=$1
+    input=./bench_tmp/reuse${decls}.txt
+    a="$(sum_factor x y 200)$(sum_factor y z 200)"
+    b="$(sum_factor x z 100)(x + y + z + 1)(x + y + z + 1)(x + y + z + 1)"
+    c="$(sum_factor x y 100)$(sum_factor x z 100)"
+    {
+        printf "TASKS 5\nPOLY\n"
+        for i in $(seq 1 $decls); do
+            printf "F%d(x,y,z) = %d x^%d + %s - %s + %s;\n" $i $i $i "$a" "$b" "$c"
+        done
+        printf "EXECUTE OUTPUT a;\nINPUTS 1\n"
+    } > $input
+    stats=$(./a.out --stats < $input 2>&1 >/dev/null | grep expansion-cache)
+    hit_rate=$(sed -n 's/.*hit-rate=\([0-9]*%\).*/\1/p' <<< "$stats")
+    saved=$(sed -n 's/.*saved-ms=\([0-9]*\).*/\1/p' <<< "$stats")
+    uncached_time=$(seconds sh -c "./a.out --no-expansion-cache < $input")
+    cached_time=$(seconds sh -c "./a.out < $input")
+    ./a.out --no-expansion-cache < $input > ./bench_tmp/uncached.out
+    ./a.out < $input > ./bench_tmp/cached.out
+    if cmp -s ./bench_tmp/uncached.out ./bench_tmp/cached.out; then check=same; else check=DIFFERENT; fi
+    printf "%6s %10s %10s %10s %12s %10s\n" $decls $check $hit_rate $saved $uncached_time $cached_time
+}
+
+printf "%6s %10s %10s %10s %12s %10s\n" decls output "hit rate" "saved ms" "uncached s" "cached s"
+
+for decls in 1 4 16 64; do
+    run $decls
+done
@@ -0,0 +1,59 @@
+#!/bin/bash
+#
+# Task 2 with --jit: time to run an EXECUTE section of many calls to a few
+# small declarations, interpreted and compiled to native code after 1 and
+# 1000 calls. The output of every run is compared with the interpreted one,
+# and a --jit-verify run, which interprets every compiled call as well,
+# counts the results that differ. Run from the directory that contains a.out:
+#
+#   ./benchmarks/jit.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# Three declarations of 400 terms, some parenthesized, and 60000 calls that
+# chain their results so that none is a dead assignment
+input=./bench_tmp/jit.txt
+awk 'BEGIN {
+    print "TASKS 2";
+    print "POLY";
+    for (p = 1; p <= 3; p++) {
+        printf "F%d(x, y, z) = ", p;
+        for (j = 1; j <= 400; j++) {
+            if (j > 1) printf (j % 3 ? " + " : " - ");
+            if (j % 8 == 0) printf "(x + %d y)(z - %d x^2)", j, p;
+            else printf "%d x^%d y^%d z^%d", j + p, j % 5 + 1, (j + p) % 4 + 1, j % 3 + 1;
+        }
+        print ";";
+    }
+    print "EXECUTE";
+    print "INPUT a;";
+    print "INPUT b;";
+    print "INPUT c;";
+    for (i = 1; i <= 20000; i++) {
+        print "a = F1(a, b, c);";
+        print "b = F2(b, c, a);";
+        print "c = F3(c, a, " i ");";
+        if (i % 200 == 0) print "OUTPUT c;";
+    }
+    print "OUTPUT a;";
+    print "OUTPUT b;";
+    print "INPUTS 3 5 7";
+}' > $input
+
+./a.out < $input > ./bench_tmp/interpreted.out
+interpreted_time=$(seconds sh -c "./a.out < $input")
+
+printf "%12s %10s %10s %10s\n" mode output seconds speedup
+printf "%12s %10s %10s %10s\n" interpreted same $interpreted_time 1.00
+
+for threshold in 1 1000; do
+    ./a.out --jit $threshold < $input > ./bench_tmp/jit.out
+    if cmp -s ./bench_tmp/interpreted.out ./bench_tmp/jit.out; then check=same; else check=DIFFERENT; fi
+    time=$(seconds sh -c "./a.out --jit $threshold < $input")
+    speedup=$(ratio $interpreted_time $time)
+    printf "%12s %10s %10s %10s\n" "jit $threshold" $check $time $speedup
+done
+
+mismatches=$(./a.out --jit 1 --jit-verify < $input 2>&1 >/dev/null | grep -c "^jit mismatch")
+echo "jit-verify mismatches: $mismatches"
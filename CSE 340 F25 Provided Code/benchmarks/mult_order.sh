@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# Task 5 factor ordering: intermediate terms and time of left-to-right
+# multiplication versus the planned order, on chains that mix small and
+# large factors. Run from the directory that contains a.out:
+#
+#   ./benchmarks/mult_order.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# sum_factor VAR1 VAR2 N: (VAR1 VAR2 + VAR1^2 VAR2 + ... ) with N terms
+sum_factor() {
+    awk -v a=$1 -v b=$2 -v n=$3 'BEGIN {
+        printf "(";
+        for (i = 1; i <= n; i++) {
+            if (i > 1) printf " + ";
+            printf "%s^%d %s^%d", a, (i - 1) % 10 + 1, b, int((i - 1) / 10) + 1;
+        }
+        printf ")";
+    }'
+}
+
+# The planned run reports the intermediate terms of both orders
+run() {
+    name=$1
+    input=./bench_tmp/${name}.txt
+    printf "TASKS 5\nPOLY F(x,y,z) = %s;\nEXECUTE OUTPUT a;\nINPUTS 1\n" "$2" > $input
+    stats=$(./a.out --stats --mult-order planned < $input 2>&1 >/dev/null | grep mult-order)
+    left_terms=$(sed -n 's/.*left-to-right-terms=\([0-9]*\).*/\1/p' <<< "$stats")
+    planned_terms=$(sed -n 's/.*planned-terms=\([0-9]*\).*/\1/p' <<< "$stats")
+    left_time=$(seconds sh -c "./a.out --mult-order left < $input")
+    planned_time=$(seconds sh -c "./a.out --mult-order planned < $input")
+    printf "%-20s %12s %12s %10s %10s\n" $name $left_terms $planned_terms $left_time $planned_time
+}
+
+printf "%-20s %12s %12s %10s %10s\n" chain "left terms" "plan terms" "left s" "plan s"
+
+run "small-large-small" "(x + y)$(sum_factor y z 200)(x + 1)"
+run "large-small-large" "$(sum_factor x y 100)(z + 1)$(sum_factor y z 100)"
+run "large-large-small" "$(sum_factor x y 150)$(sum_factor x z 150)(x + y + z)"
+run "many-small" "(x + 1)(y + 1)(z + 1)(x + y)(y + z)(x + z)(x + y + z)$(sum_factor x z 60)"
@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+# Task 2 with --parallel-execute: time to run an EXECUTE section of heavy
+# polynomial calls, most of them independent of each other, with 1 to 8
+# threads. The output of every run is compared with the sequential one.
+# Run from the directory that contains a.out:
+#
+#   ./benchmarks/parallel_execute.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# Two declarations of 20000 terms; 64 chains of 16 calls, one per variable,
+# each chain started from an input and output at the end
+input=./bench_tmp/execute.txt
+awk 'BEGIN {
+    print "TASKS 2";
+    print "POLY";
+    for (p = 1; p <= 2; p++) {
+        printf "F%d(x, y) = ", p;
+        for (j = 1; j <= 20000; j++) {
+            if (j > 1) printf " + ";
+            printf "%d x^%d y^%d", j % 13 + p, j % 17 + 1, j % 11 + 1;
+        }
+        print ";";
+    }
+    print "EXECUTE";
+    for (v = 1; v <= 64; v++) printf "INPUT v%d;\n", v;
+    for (step = 1; step <= 16; step++) {
+        for (v = 1; v <= 64; v++) {
+            printf "v%d = F%d(v%d, %d);\n", v, step % 2 + 1, v, step;
+        }
+    }
+    for (v = 1; v <= 64; v++) printf "OUTPUT v%d;\n", v;
+    print "INPUTS";
+    for (v = 1; v <= 64; v++) printf "%d ", v;
+    print "";
+}' > $input
+
+./a.out < $input > ./bench_tmp/sequential.out
+sequential_time=$(seconds sh -c "./a.out < $input")
+
+printf "%8s %10s %10s %10s\n" threads output seconds speedup
+printf "%8s %10s %10s %10s\n" sequential same $sequential_time 1.00
+
+for threads in 1 2 4 8; do
+    ./a.out --parallel-execute --threads $threads < $input > ./bench_tmp/parallel.out
+    if cmp -s ./bench_tmp/sequential.out ./bench_tmp/parallel.out; then check=same; else check=DIFFERENT; fi
+    time=$(seconds sh -c "./a.out --parallel-execute --threads $threads < $input")
+    speedup=$(ratio $sequential_time $time)
+    printf "%8s %10s %10s %10s\n" $threads $check $time $speedup
+done
@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Parallel lexing: time to tokenize a generated program of SIZE megabytes
+# (default 1024) with --lex-threads 1 to 8, as reported by --stats, and the
+# speedup over one thread. The program is mostly a long INPUTS section and
+# is only checked (--check), so the times are dominated by lexing. Every
+# token is kept in memory, about 40 bytes per token (some 7 GB for 1 GB of
+# input). Run from the directory that contains a.out:
+#
+#   ./benchmarks/parallel_lex.sh [SIZE]
+#
+
+. "$(dirname "$0")/common.sh"
+
+size=${1:-1024}
+input=./bench_tmp/large.txt
+
+awk -v megabytes=$size 'BEGIN {
+    print "TASKS 1 2";
+    print "POLY";
+    print "F(x, y) = 3 x^2 y + 2 x y^3 - (x + 1)(y - 1);";
+    print "EXECUTE";
+    print "INPUT a;";
+    print "a = F(a, 2);";
+    print "OUTPUT a;";
+    print "INPUTS";
+    line = "";
+    for (i = 0; i < 16; i++) line = line sprintf("%d ", 1000 + i * 37);
+    lines = int(megabytes * 1048576 / (length(line) + 1));
+    for (i = 0; i < lines; i++) print line;
+}' > $input
+
+lex_ms() {
+    ./a.out --check --stats --lex-threads $1 < $input 2>&1 >/dev/null |
+        sed -n 's/^stats: lex .* ms=\([0-9]*\)$/\1/p'
+}
+
+./a.out --lex-threads 1 < $input > ./bench_tmp/serial.out
+
+printf "%8s %10s %10s %10s\n" threads output "lex ms" speedup
+serial_ms=$(lex_ms 1)
+for threads in 1 2 4 8; do
+    ./a.out --lex-threads $threads < $input > ./bench_tmp/parallel.out
+    if cmp -s ./bench_tmp/serial.out ./bench_tmp/parallel.out; then check=same; else check=DIFFERENT; fi
+    ms=$(lex_ms $threads)
+    speedup=$(ratio $serial_ms $ms)
+    printf "%8s %10s %10s %10s\n" $threads $check $ms $speedup
+done
@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Parallel POLY parsing: parse time (from --stats, lexing excluded) of a
+# POLY section of many declarations with --parallel-poly and 1 to 8
+# threads, against the serial parser. Task 3 output is compared with the
+# serial one. Run from the directory that contains a.out:
+#
+#   ./benchmarks/parallel_poly.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+input=./bench_tmp/poly.txt
+
+# 20000 declarations of 40 terms over three parameters
+awk 'BEGIN {
+    print "TASKS 3";
+    print "POLY";
+    for (i = 1; i <= 20000; i++) {
+        printf "F%d(x, y, z) = ", i;
+        for (j = 1; j <= 40; j++) {
+            if (j > 1) printf (j % 3 ? " + " : " - ");
+            if (j % 10 == 0) printf "(x + %d y)(z - x^2)", j;
+            else printf "%d x^%d y z^%d", j, (i + j) % 6 + 1, j % 4 + 1;
+        }
+        print ";";
+    }
+    print "EXECUTE";
+    print "OUTPUT a;";
+    print "INPUTS 1";
+}' > $input
+
+parse_ms() {
+    ./a.out --stats "$@" < $input 2>&1 >/dev/null | sed -n 's/^stats: parse .* ms=\([0-9]*\) .*/\1/p'
+}
+
+./a.out < $input > ./bench_tmp/serial.out
+serial_ms=$(parse_ms)
+
+printf "%8s %10s %10s %10s\n" threads output "parse ms" speedup
+printf "%8s %10s %10s %10s\n" serial same $serial_ms 1.00
+for threads in 2 4 8; do
+    ./a.out --parallel-poly --threads $threads < $input > ./bench_tmp/parallel.out
+    if cmp -s ./bench_tmp/serial.out ./bench_tmp/parallel.out; then check=same; else check=DIFFERENT; fi
+    ms=$(parse_ms --parallel-poly --threads $threads)
+    speedup=$(ratio $serial_ms $ms)
+    printf "%8s %10s %10s %10s\n" $threads $check $ms $speedup
+done
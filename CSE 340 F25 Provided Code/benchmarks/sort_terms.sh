@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Task 5 term sorting: time spent in sort_terms() with precomputed keys
+# (radix sorted when they fit in 64 bits) versus comparison sorting with
+# term_less_than(), on expansions of about 10^6 distinct terms, with a
+# check that both orders print the same output. Run from the directory
+# that contains a.out:
+#
+#   ./benchmarks/sort_terms.sh
+#
+
+. "$(dirname "$0")/common.sh"
+
+# sum_factor N MAXPOWER VAR...: N terms with distinct monomials over VARs
+sum_factor() {
+    n=$1
+    max=$2
+    shift 2
+    awk -v n=$n -v max=$max -v vars="$*" 'BEGIN {
+        count = split(vars, v, " ");
+        printf "(";
+        for (i = 0; i < n; i++) {
+            if (i > 0) printf " + ";
+            rest = i;
+            for (k = 1; k <= count; k++) {
+                if (k > 1) printf " ";
+                printf "%s^%d", v[k], rest % max + 1;
+                rest = int(rest / max);
+            }
+        }
+        printf ")";
+    }'
+}
+
+sort_ms() {
+    ./a.out --stats "$@" 2>&1 >/dev/null | sed -n 's/stats: sort .*method=\([a-z]*\).* ms=\([0-9.]*\)/\1 \2/p'
+}
+
+run() {
+    name=$1
+    input=./bench_tmp/${name}.txt
+    printf "TASKS 5\nPOLY F(%s) = %s%s;\nEXECUTE OUTPUT a;\nINPUTS 1\n" "$2" "$3" "$4" > $input
+    ./a.out < $input > ./bench_tmp/keyed.out
+    ./a.out --term-sort comparison < $input > ./bench_tmp/comparison.out
+    if cmp -s ./bench_tmp/keyed.out ./bench_tmp/comparison.out; then check=same; else check=DIFFERENT; fi
+    read keyed_method keyed_ms <<< "$(sort_ms < $input)"
+    read comparison_method comparison_ms <<< "$(sort_ms --term-sort comparison < $input)"
+    keyed_time=$(seconds sh -c "./a.out < $input")
+    comparison_time=$(seconds sh -c "./a.out --term-sort comparison < $input")
+    printf "%-12s %10s %8s %10s %14s %10s %14s\n" $name $check $keyed_method $keyed_ms $comparison_ms \
+        $keyed_time $comparison_time
+}
+
+printf "%-12s %10s %8s %10s %14s %10s %14s\n" expansion output method "sort ms" "comparison ms" "total s" \
+    "comparison s"
+
+# 1000 x 1000 products, all distinct
+run "4-params" "a,b,c,d" "$(sum_factor 1000 40 a b)" "$(sum_factor 1000 40 c d)"
+run "8-params" "a,b,c,d,e,f,g,h" "$(sum_factor 1000 6 a b c d)" "$(sum_factor 1000 6 e f g h)"
+# 12 parameters with powers up to 40 need more than 64 key bits
+run "12-params" "a,b,c,d,e,f,g,h,i,j,k,l" "$(sum_factor 1000 40 a b c d e f)" "$(sum_factor 1000 40 g h i j k l)"
@@ -0,0 +1,171 @@
+/*
+ * Dense multiplication of term lists, see dense.h
+ */
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "dense.h"
+
+using namespace std;
+
+// Below this length Karatsuba falls back to the schoolbook product
+#define KARATSUBA_CUTOFF 32
+
+// Cost of one schoolbook term product in multiply-adds, see benchmarks/dense_mult.sh
+#define DENSE_TERM_COST 256.0
+
+struct DenseLayout {
+    vector<int> min1, min2;     // smallest exponent of every parameter
+    vector<uint64_t> strides;   // Kronecker weight of every parameter
+    uint64_t result_length;     // product of the bases
+    uint64_t max_index1, max_index2;
+};
+
+static bool dense_layout(const vector<TermNode>& list1, const vector<TermNode>& list2,
+                         size_t param_count, DenseLayout& layout)
+{
+    vector<int> max1(param_count, 0), max2(param_count, 0);
+    layout.min1.assign(param_count, INT32_MAX);
+    layout.min2.assign(param_count, INT32_MAX);
+    for (const auto& term : list1) {
+        if (term.kind != MLIST || term.monomial_list.size() != param_count) return false;
+        for (size_t k = 0; k < param_count; k++) {
+            layout.min1[k] = min(layout.min1[k], term.monomial_list[k]);
+            max1[k] = max(max1[k], term.monomial_list[k]);
+        }
+    }
+    for (const auto& term : list2) {
+        if (term.kind != MLIST || term.monomial_list.size() != param_count) return false;
+        for (size_t k = 0; k < param_count; k++) {
+            layout.min2[k] = min(layout.min2[k], term.monomial_list[k]);
+            max2[k] = max(max2[k], term.monomial_list[k]);
+        }
+    }
+    if (list1.empty() || list2.empty()) return false;
+
+    layout.strides.resize(param_count);
+    layout.result_length = 1;
+    layout.max_index1 = layout.max_index2 = 0;
+    for (size_t k = 0; k < param_count; k++) {
+        uint64_t base = (uint64_t)(max1[k] - layout.min1[k]) + (max2[k] - layout.min2[k]) + 1;
+        layout.strides[k] = layout.result_length;
+        layout.max_index1 += (uint64_t)(max1[k] - layout.min1[k]) * layout.strides[k];
+        layout.max_index2 += (uint64_t)(max2[k] - layout.min2[k]) * layout.strides[k];
+        layout.result_length *= base;
+        if (layout.result_length > 2 * (uint64_t)DENSE_MAX_LENGTH) return false;
+    }
+    return true;
+}
+
+size_t dense_length(const vector<TermNode>& list1, const vector<TermNode>& list2, size_t param_count)
+{
+    DenseLayout layout;
+    if (!dense_layout(list1, list2, param_count, layout)) return 0;
+
+    // Both inputs are padded to one power of two; the product of the two
+    // arrays (max_index1 + max_index2 + 1 words) fits in twice that
+    size_t length = 1;
+    while (length <= max(layout.max_index1, layout.max_index2)) length *= 2;
+    return length <= DENSE_MAX_LENGTH ? length : 0;
+}
+
+bool dense_is_profitable(size_t length, size_t size1, size_t size2)
+{
+    // Karatsuba does 3^log2(n / cutoff) schoolbook blocks of cutoff^2
+    // multiply-adds; a schoolbook term product allocates a TermNode and
+    // has to be combined afterwards, which costs a few hundred of them
+    double dense_cost = pow(3.0, log2((double)length / KARATSUBA_CUTOFF)) * KARATSUBA_CUTOFF * KARATSUBA_CUTOFF
+                        + 4.0 * length;
+    double schoolbook_cost = DENSE_TERM_COST * size1 * size2;
+    return dense_cost < schoolbook_cost;
+}
+
+static void schoolbook(const uint32_t* a, const uint32_t* b, uint32_t* r, size_t n)
+{
+    fill(r, r + 2 * n, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] == 0) continue;
+        for (size_t j = 0; j < n; j++) {
+            r[i + j] += a[i] * b[j];
+        }
+    }
+}
+
+// r[0..2n) = a[0..n) * b[0..n), n a power of two; scratch holds 4n words
+static void karatsuba(const uint32_t* a, const uint32_t* b, uint32_t* r, size_t n, uint32_t* scratch)
+{
+    if (n <= KARATSUBA_CUTOFF) {
+        schoolbook(a, b, r, n);
+        return;
+    }
+    size_t h = n / 2;
+    const uint32_t *a0 = a, *a1 = a + h, *b0 = b, *b1 = b + h;
+
+    karatsuba(a0, b0, r, h, scratch);          // z0 → r[0, n)
+    karatsuba(a1, b1, r + n, h, scratch);      // z2 → r[n, 2n)
+
+    uint32_t* sum_a = scratch;
+    uint32_t* sum_b = scratch + h;
+    uint32_t* z1 = scratch + n;
+    for (size_t i = 0; i < h; i++) {
+        sum_a[i] = a0[i] + a1[i];
+        sum_b[i] = b0[i] + b1[i];
+    }
+    karatsuba(sum_a, sum_b, z1, h, scratch + 2 * n);
+    for (size_t i = 0; i < n; i++) {
+        z1[i] -= r[i] + r[n + i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        r[h + i] += z1[i];
+    }
+}
+
+void karatsuba_multiply(const vector<uint32_t>& a, const vector<uint32_t>& b, vector<uint32_t>& r)
+{
+    size_t n = a.size();
+    r.assign(2 * n, 0);
+    vector<uint32_t> scratch(4 * n);
+    karatsuba(a.data(), b.data(), r.data(), n, scratch.data());
+}
+
+vector<TermNode> multiply_dense(const vector<TermNode>& list1, const vector<TermNode>& list2,
+                                size_t param_count, size_t length)
+{
+    DenseLayout layout;
+    dense_layout(list1, list2, param_count, layout);
+
+    vector<uint32_t> a(length, 0), b(length, 0), r;
+    auto scatter = [&](const vector<TermNode>& list, const vector<int>& mins, vector<uint32_t>& dense) {
+        for (const auto& term : list) {
+            uint64_t index = 0;
+            for (size_t k = 0; k < param_count; k++) {
+                index += (uint64_t)(term.monomial_list[k] - mins[k]) * layout.strides[k];
+            }
+            int coefficient = (term.op == OP_MINUS) ? -term.coefficient : term.coefficient;
+            dense[index] += (uint32_t)coefficient;
+        }
+    };
+    scatter(list1, layout.min1, a);
+    scatter(list2, layout.min2, b);
+    karatsuba_multiply(a, b, r);
+
+    vector<TermNode> result;
+    for (uint64_t index = 0; index < layout.result_length; index++) {
+        int coefficient = (int)r[index];
+        if (coefficient == 0) continue;
+
+        TermNode product;
+        product.kind = MLIST;
+        product.op = (coefficient > 0) ? OP_PLUS : OP_MINUS;
+        product.coefficient = (coefficient > 0) ? coefficient : -coefficient;
+        product.monomial_list.resize(param_count);
+        uint64_t rest = index;
+        for (size_t k = param_count; k-- > 0;) {
+            product.monomial_list[k] = (int)(rest / layout.strides[k]) + layout.min1[k] + layout.min2[k];
+            rest %= layout.strides[k];
+        }
+        result.push_back(product);
+    }
+    return result;
+}
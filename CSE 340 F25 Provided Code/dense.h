@@ -0,0 +1,43 @@
+/*
+ * Dense multiplication of term lists for Task 5
+ *
+ * Every monomial of a list is mapped to a single integer by Kronecker
+ * substitution: with base B_k = (degree range of parameter k in list1) +
+ * (degree range in list2) + 1, the exponent vector e becomes
+ * sum (e_k - min_k) * B_0 * ... * B_{k-1}. Products of monomials then
+ * become sums of these indices without carries, so the product of the two
+ * polynomials is the product of two univariate coefficient arrays, which is
+ * computed with Karatsuba's algorithm and mapped back.
+ *
+ * Coefficients are multiplied and added modulo 2^32, which is exactly the
+ * int wraparound of the schoolbook path.
+ */
+#ifndef __DENSE__H__
+#define __DENSE__H__
+
+#include <cstdint>
+#include <vector>
+
+#include "parser.h"
+
+// Largest padded array length multiply_dense() will allocate
+#define DENSE_MAX_LENGTH (1 << 22)
+
+// Padded length of the dense arrays for list1 * list2, or 0 if the lists
+// contain parenthesized terms or the length would exceed DENSE_MAX_LENGTH
+size_t dense_length(const std::vector<TermNode>& list1, const std::vector<TermNode>& list2, size_t param_count);
+
+// True if the dense product is expected to be cheaper than the n*m
+// schoolbook product
+bool dense_is_profitable(size_t length, size_t size1, size_t size2);
+
+// Product of two MLIST-only term lists with identical monomials combined and
+// zero terms dropped, in no particular order. `length` comes from
+// dense_length() and must not be 0.
+std::vector<TermNode> multiply_dense(const std::vector<TermNode>& list1, const std::vector<TermNode>& list2,
+                                     size_t param_count, size_t length);
+
+// r = a * b for arrays of the same power-of-two length n; r has length 2n
+void karatsuba_multiply(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, std::vector<uint32_t>& r);
+
+#endif  //__DENSE__H__
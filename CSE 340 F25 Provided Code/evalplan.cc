@@ -0,0 +1,167 @@
+/*
+ * Evaluation plans, see evalplan.h
+ */
+#include "evalplan.h"
+#include "jit.h"
+#include "parser.h"
+
+using namespace std;
+
+#define NO_SLOT UINT32_MAX
+
+EvalPlan::EvalPlan(const FlatView& view, uint32_t root_list, int arity)
+    : arity(arity), coefficient_products(0), naive(0)
+{
+    root = lists.size();
+    lists.push_back(List());
+    fill_list(root, view, root_list);
+    unordered_map<uint64_t, uint32_t>().swap(products);
+}
+
+// The terms of one list are collected locally and appended at the end so
+// that they stay contiguous even though nested factors are added first
+void EvalPlan::fill_list(uint32_t slot, const FlatView& view, uint32_t list)
+{
+    const FlatList& range = view.lists[list];
+    vector<Term> local;
+    for (uint32_t i = 0; i < range.term_count; i++) {
+        const FlatTerm& flat = view.terms[range.first_term + i];
+        Term term;
+        term.kind = flat.kind;
+        term.op = flat.op;
+        term.coefficient = flat.coefficient;
+        term.slot = NO_SLOT;
+        term.first = 0;
+        term.count = 0;
+        if (flat.kind == MLIST) {
+            term.slot = add_monomial(view, flat);
+            if (term.slot != NO_SLOT) {
+                coefficient_products++;
+            }
+        } else {
+            term.first = lists.size();
+            term.count = flat.count;
+            lists.resize(lists.size() + flat.count);
+            for (uint32_t j = 0; j < flat.count; j++) {
+                fill_list(term.first + j, view, flat.first + j);
+            }
+        }
+        local.push_back(term);
+    }
+    lists[slot].first_term = terms.size();
+    lists[slot].term_count = local.size();
+    terms.insert(terms.end(), local.begin(), local.end());
+}
+
+// Slot of the product of the powers of a monomial: one step per parameter
+// on top of the slot of the monomial's prefix
+uint32_t EvalPlan::add_monomial(const FlatView& view, const FlatTerm& term)
+{
+    uint32_t product = NO_SLOT;
+    for (uint32_t i = 0; i < term.count && i < (uint32_t)arity; i++) {
+        int32_t exponent = view.exps[term.first + i];
+        if (exponent <= 0) {
+            continue;
+        }
+        naive += exponent;
+        uint32_t factor = power(i, exponent);
+        product = (product == NO_SLOT) ? factor : multiply(product, factor);
+    }
+    return product;
+}
+
+uint32_t EvalPlan::power(uint32_t parameter, int32_t exponent)
+{
+    if (exponent == 1) {
+        return parameter;
+    }
+    uint32_t half = power(parameter, exponent / 2);
+    uint32_t square = multiply(half, half);
+    return (exponent % 2) ? multiply(square, parameter) : square;
+}
+
+uint32_t EvalPlan::multiply(uint32_t left, uint32_t right)
+{
+    uint64_t key = ((uint64_t)left << 32) | right;
+    auto found = products.find(key);
+    if (found != products.end()) {
+        return found->second;
+    }
+    uint32_t slot = arity + steps.size();
+    steps.push_back(Step{left, right});
+    products.emplace(key, slot);
+    return slot;
+}
+
+// Unsigned arithmetic wraps around modulo 2^32, like flat_evaluate()
+int EvalPlan::evaluate(const int* args) const
+{
+    uint32_t stack_slots[PLAN_STACK_SLOTS];
+    vector<uint32_t> heap_slots;
+    uint32_t* slots = stack_slots;
+    if (arity + steps.size() > PLAN_STACK_SLOTS) {
+        heap_slots.resize(arity + steps.size());
+        slots = heap_slots.data();
+    }
+
+    for (int i = 0; i < arity; i++) {
+        slots[i] = args[i];
+    }
+    uint32_t* result = slots + arity;
+    for (const Step& step : steps) {
+        *result++ = slots[step.left] * slots[step.right];
+    }
+    return (int)evaluate_list(slots, root);
+}
+
+uint32_t EvalPlan::evaluate_list(const uint32_t* slots, uint32_t list) const
+{
+    const List& range = lists[list];
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < range.term_count; i++) {
+        const Term& term = terms[range.first_term + i];
+        uint32_t value;
+        if (term.kind == MLIST) {
+            value = term.coefficient;
+            if (term.slot != NO_SLOT) {
+                value *= slots[term.slot];
+            }
+        } else {
+            value = 1;
+            for (uint32_t j = 0; j < term.count; j++) {
+                value *= evaluate_list(slots, term.first + j);
+            }
+        }
+        if (i == 0) {
+            result = (term.op == OP_MINUS) ? -value : value;
+        } else {
+            result += (term.op == OP_PLUS) ? value : -value;
+        }
+    }
+    return result;
+}
+
+EvalState::EvalState() : planned(0), used(0), multiplications(0), naive_multiplications(0)
+{
+}
+
+EvalState::~EvalState()
+{
+}
+
+void EvalState::add_plan(int handle, const FlatView& view, uint32_t root, int arity)
+{
+    unique_ptr<EvalPlan> plan(new EvalPlan(view, root, arity));
+    planned++;
+    naive_multiplications += plan->naive_multiplications();
+    if (plan->multiplications() >= plan->naive_multiplications()) {
+        multiplications += plan->naive_multiplications();
+        return;
+    }
+    multiplications += plan->multiplications();
+    if (handle >= (int)plans.size()) {
+        plans.resize(handle + 1);
+    }
+    plans[handle] = move(plan);
+    used++;
+}
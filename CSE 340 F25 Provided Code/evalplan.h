@@ -0,0 +1,100 @@
+/*
+ * Evaluation plans: polynomial bodies whose monomials share their partial
+ * products
+ *
+ * flat_evaluate() multiplies out every monomial on its own, so the x^2 y of
+ * x^2 y z and x^2 y w is computed twice and x^1000 takes 1000
+ * multiplications. A plan computes every distinct product once per call:
+ * the monomials of all lists of the body are prefixes in a trie over their
+ * exponent vectors (parameters in declaration order), the powers they
+ * multiply come from a table built by repeated squaring, and identical
+ * products are merged, so the steps form a DAG. The values are the same as
+ * those of flat_evaluate(), as products modulo 2^32 do not depend on the
+ * order of the factors.
+ */
+#ifndef __EVALPLAN__H__
+#define __EVALPLAN__H__
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "flatpoly.h"
+
+class PolyJit;
+
+// Slots evaluate() keeps on the stack; larger plans use the heap
+#define PLAN_STACK_SLOTS 256
+
+class EvalPlan {
+  public:
+    // Plan of the list `root` of view for `arity` arguments
+    EvalPlan(const FlatView& view, uint32_t root, int arity);
+
+    int evaluate(const int* args) const;
+
+    // Multiplications of one call in monomials (coefficients included),
+    // with the plan and with flat_evaluate()
+    uint64_t multiplications() const { return steps.size() + coefficient_products; }
+    uint64_t naive_multiplications() const { return naive; }
+
+  private:
+    struct Step {
+        uint32_t left, right;  // slots multiplied; the result goes to slot arity + step index
+    };
+    struct Term {
+        uint8_t kind;          // TermKind
+        uint8_t op;            // OpType
+        int32_t coefficient;
+        uint32_t slot;         // MLIST: slot of the product of the powers, NO_SLOT if none
+        uint32_t first;        // PARENLIST: first factor list
+        uint32_t count;        // PARENLIST: number of factors
+    };
+    struct List {
+        uint32_t first_term;
+        uint32_t term_count;
+    };
+
+    void fill_list(uint32_t slot, const FlatView& view, uint32_t list);
+    uint32_t add_monomial(const FlatView& view, const FlatTerm& term);
+    uint32_t power(uint32_t parameter, int32_t exponent);
+    uint32_t multiply(uint32_t left, uint32_t right);
+    uint32_t evaluate_list(const uint32_t* slots, uint32_t list) const;
+
+    int arity;
+    std::vector<Step> steps;
+    std::vector<Term> terms;
+    std::vector<List> lists;
+    uint32_t root;
+    uint64_t coefficient_products;
+    uint64_t naive;
+    std::unordered_map<uint64_t, uint32_t> products;  // (left, right) → slot, while planning
+};
+
+// Task 2 state of a declaration store: the plans of its declarations and
+// the JIT with its call counters. It is built once and kept as long as the
+// store, so a server or library user that runs many programs against the
+// same declarations plans them once and compiles a declaration once it is
+// hot over all of them.
+struct EvalState {
+    std::vector<std::unique_ptr<EvalPlan>> plans;  // by handle, null = evaluate the body as written
+    std::unique_ptr<PolyJit> jit;                  // null = no JIT
+    int planned;
+    int used;
+    uint64_t multiplications;                      // per call of every planned declaration
+    uint64_t naive_multiplications;
+
+    EvalState();
+    ~EvalState();
+
+    // Plans a body and keeps the plan if it needs fewer multiplications
+    // than the body as written
+    void add_plan(int handle, const FlatView& view, uint32_t root, int arity);
+    const EvalPlan* plan(int handle) const
+    {
+        return handle >= 0 && handle < (int)plans.size() ? plans[handle].get() : nullptr;
+    }
+};
+
+#endif  //__EVALPLAN__H__
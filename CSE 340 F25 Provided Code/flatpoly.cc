@@ -0,0 +1,232 @@
+/*
+ * Flattened polynomial bodies, see flatpoly.h
+ */
+#include <utility>
+#include <vector>
+
+#include "flatpoly.h"
+#include "parser.h"
+
+using namespace std;
+
+uint32_t FlatBuilder::add_body(const vector<TermNode>& body)
+{
+    uint32_t slot = lists.size();
+    lists.push_back(FlatList());
+    fill_list(slot, body);
+    return slot;
+}
+
+uint32_t FlatBuilder::add_list(const FlatView& source, uint32_t list)
+{
+    uint32_t slot = lists.size();
+    lists.push_back(FlatList());
+    copy_list(slot, source, list);
+    return slot;
+}
+
+FlatView FlatBuilder::view() const
+{
+    FlatView view;
+    view.terms = terms.data();
+    view.lists = lists.data();
+    view.exps = exps.data();
+    return view;
+}
+
+// The records of one list are collected locally and appended at the end so
+// that they stay contiguous even though nested factors are added first
+void FlatBuilder::fill_list(uint32_t slot, const vector<TermNode>& term_list)
+{
+    vector<FlatTerm> local;
+    for (const TermNode& term : term_list) {
+        FlatTerm flat;
+        flat.kind = term.kind;
+        flat.op = term.op;
+        flat.reserved = 0;
+        flat.coefficient = term.coefficient;
+        if (term.kind == MLIST) {
+            flat.first = exps.size();
+            flat.count = term.monomial_list.size();
+            exps.insert(exps.end(), term.monomial_list.begin(), term.monomial_list.end());
+        } else {
+            flat.first = lists.size();
+            flat.count = term.parenthesized_list.size();
+            lists.resize(lists.size() + flat.count);
+            for (uint32_t i = 0; i < flat.count; i++) {
+                fill_list(flat.first + i, term.parenthesized_list[i]);
+            }
+        }
+        local.push_back(flat);
+    }
+
+    lists[slot].first_term = terms.size();
+    lists[slot].term_count = local.size();
+    terms.insert(terms.end(), local.begin(), local.end());
+}
+
+void FlatBuilder::copy_list(uint32_t slot, const FlatView& source, uint32_t list)
+{
+    const FlatList& range = source.lists[list];
+    vector<FlatTerm> local(source.terms + range.first_term, source.terms + range.first_term + range.term_count);
+    for (FlatTerm& flat : local) {
+        if (flat.kind == MLIST) {
+            uint32_t first = exps.size();
+            exps.insert(exps.end(), source.exps + flat.first, source.exps + flat.first + flat.count);
+            flat.first = first;
+        } else {
+            uint32_t first = lists.size();
+            lists.resize(lists.size() + flat.count);
+            for (uint32_t i = 0; i < flat.count; i++) {
+                copy_list(first + i, source, flat.first + i);
+            }
+            flat.first = first;
+        }
+    }
+
+    lists[slot].first_term = terms.size();
+    lists[slot].term_count = local.size();
+    terms.insert(terms.end(), local.begin(), local.end());
+}
+
+void FlatBody::clear()
+{
+    terms.clear();
+    lists.clear();
+    exps.clear();
+    root = 0;
+}
+
+size_t FlatBody::bytes() const
+{
+    return terms.size() * sizeof(FlatTerm) + lists.size() * sizeof(FlatList) + exps.size() * sizeof(int32_t);
+}
+
+// The evaluators compute in uint32_t, where overflow wraps around modulo
+// 2^32 (signed int overflow is undefined), and convert to int at the end,
+// like EvalPlan and the JIT
+static uint32_t evaluate_list(const FlatView& view, uint32_t list, const vector<int>& arg_values);
+
+static uint32_t evaluate_term(const FlatView& view, const FlatTerm& term, const vector<int>& arg_values)
+{
+    if (term.kind == MLIST) {
+        uint32_t result = term.coefficient;
+        for (uint32_t i = 0; i < term.count && i < arg_values.size(); i++) {
+            int power = view.exps[term.first + i];
+            for (int j = 0; j < power; j++) {
+                result *= (uint32_t)arg_values[i];
+            }
+        }
+        return result;
+    }
+
+    uint32_t result = 1;
+    for (uint32_t i = 0; i < term.count; i++) {
+        result *= evaluate_list(view, term.first + i, arg_values);
+    }
+    return result;
+}
+
+static uint32_t evaluate_list(const FlatView& view, uint32_t list, const vector<int>& arg_values)
+{
+    const FlatList& range = view.lists[list];
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < range.term_count; i++) {
+        const FlatTerm& term = view.terms[range.first_term + i];
+        uint32_t term_value = evaluate_term(view, term, arg_values);
+        if (i == 0) {
+            result = (term.op == OP_MINUS) ? -term_value : term_value;
+        } else {
+            result += (term.op == OP_PLUS) ? term_value : -term_value;
+        }
+    }
+    return result;
+}
+
+int flat_evaluate(const FlatView& view, uint32_t list, const vector<int>& arg_values)
+{
+    return (int)evaluate_list(view, list, arg_values);
+}
+
+static inline uint32_t multiply_power(uint32_t result, uint32_t value, int32_t power)
+{
+    for (int32_t j = 0; j < power; j++) {
+        result *= value;
+    }
+    return result;
+}
+
+template <size_t N, size_t... I>
+static inline uint32_t fixed_monomial(const FlatTerm& term, const int32_t* exps, const array<int, N>& args,
+                                      index_sequence<I...>)
+{
+    uint32_t result = term.coefficient;
+    ((result = multiply_power(result, args[I], exps[I])), ...);
+    return result;
+}
+
+template <size_t N>
+static uint32_t evaluate_fixed_list(const FlatView& view, uint32_t list, const array<int, N>& args)
+{
+    const FlatList& range = view.lists[list];
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < range.term_count; i++) {
+        const FlatTerm& term = view.terms[range.first_term + i];
+        uint32_t term_value;
+        if (term.kind == MLIST && term.count == N) {
+            term_value = fixed_monomial(term, view.exps + term.first, args, make_index_sequence<N>());
+        } else if (term.kind == MLIST) {
+            term_value = term.coefficient;
+            for (uint32_t j = 0; j < term.count && j < N; j++) {
+                term_value = multiply_power(term_value, args[j], view.exps[term.first + j]);
+            }
+        } else {
+            term_value = 1;
+            for (uint32_t j = 0; j < term.count; j++) {
+                term_value *= evaluate_fixed_list(view, term.first + j, args);
+            }
+        }
+        if (i == 0) {
+            result = (term.op == OP_MINUS) ? -term_value : term_value;
+        } else {
+            result += (term.op == OP_PLUS) ? term_value : -term_value;
+        }
+    }
+    return result;
+}
+
+template <size_t N>
+int flat_evaluate_fixed(const FlatView& view, uint32_t list, const array<int, N>& args)
+{
+    return (int)evaluate_fixed_list(view, list, args);
+}
+
+template int flat_evaluate_fixed<1>(const FlatView&, uint32_t, const array<int, 1>&);
+template int flat_evaluate_fixed<2>(const FlatView&, uint32_t, const array<int, 2>&);
+template int flat_evaluate_fixed<3>(const FlatView&, uint32_t, const array<int, 3>&);
+template int flat_evaluate_fixed<4>(const FlatView&, uint32_t, const array<int, 4>&);
+template int flat_evaluate_fixed<5>(const FlatView&, uint32_t, const array<int, 5>&);
+template int flat_evaluate_fixed<6>(const FlatView&, uint32_t, const array<int, 6>&);
+template int flat_evaluate_fixed<7>(const FlatView&, uint32_t, const array<int, 7>&);
+template int flat_evaluate_fixed<8>(const FlatView&, uint32_t, const array<int, 8>&);
+
+vector<TermNode> flat_to_terms(const FlatView& view, uint32_t list)
+{
+    const FlatList& range = view.lists[list];
+    vector<TermNode> result(range.term_count);
+    for (uint32_t i = 0; i < range.term_count; i++) {
+        const FlatTerm& flat = view.terms[range.first_term + i];
+        TermNode& term = result[i];
+        term.kind = (TermKind)flat.kind;
+        term.op = (OpType)flat.op;
+        term.coefficient = flat.coefficient;
+        if (flat.kind == MLIST) {
+            term.monomial_list.assign(view.exps + flat.first, view.exps + flat.first + flat.count);
+        } else {
+            for (uint32_t j = 0; j < flat.count; j++) {
+                term.parenthesized_list.push_back(flat_to_terms(view, flat.first + j));
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,84 @@
+/*
+ * Flattened, position independent representation of polynomial bodies
+ *
+ * A body is a FlatList: a contiguous range of FlatTerm records. An MLIST
+ * term points at its exponents in a shared exponent pool; a PARENLIST term
+ * points at a contiguous range of FlatLists, one per parenthesized factor.
+ * Only indices are stored, so the arrays can be written to a file and used
+ * from a mapping without any fix-ups.
+ */
+#ifndef __FLATPOLY__H__
+#define __FLATPOLY__H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TermNode;
+
+struct FlatTerm {
+    uint8_t kind;         // TermKind
+    uint8_t op;           // OpType
+    uint16_t reserved;
+    int32_t coefficient;
+    uint32_t first;       // MLIST: index into exponent pool, PARENLIST: first factor list
+    uint32_t count;       // MLIST: number of exponents, PARENLIST: number of factors
+};
+
+struct FlatList {
+    uint32_t first_term;
+    uint32_t term_count;
+};
+
+// Read-only view; the arrays may live in a FlatBuilder or in a mapped file
+struct FlatView {
+    const FlatTerm* terms;
+    const FlatList* lists;
+    const int32_t* exps;
+};
+
+class FlatBuilder {
+  public:
+    // Appends a body and returns the index of its FlatList
+    uint32_t add_body(const std::vector<TermNode>& body);
+    // Appends a copy of a list of another view, laid out like add_body()
+    uint32_t add_list(const FlatView& source, uint32_t list);
+    FlatView view() const;
+
+    std::vector<FlatTerm> terms;
+    std::vector<FlatList> lists;
+    std::vector<int32_t> exps;
+
+  private:
+    void fill_list(uint32_t slot, const std::vector<TermNode>& term_list);
+    void copy_list(uint32_t slot, const FlatView& source, uint32_t list);
+};
+
+// The body of one declaration (RichPolyDecl::body): its own pools and the
+// index of its top-level list. The parser appends nested lists before the
+// lists that contain them; add_body() and add_list() put them after.
+struct FlatBody : public FlatBuilder {
+    uint32_t root = 0;
+
+    bool empty() const { return lists.empty() || lists[root].term_count == 0; }
+    void clear();
+    size_t bytes() const;  // size of the three pools
+};
+
+// Value of a list for the given arguments; the arithmetic wraps around
+// modulo 2^32
+int flat_evaluate(const FlatView& view, uint32_t list, const std::vector<int>& arg_values);
+
+// flat_evaluate() for a fixed number of arguments, with the exponent loop
+// of every monomial unrolled at compile time. Instantiated in flatpoly.cc
+// for 1 to FLAT_MAX_FIXED_ARITY arguments.
+#define FLAT_MAX_FIXED_ARITY 8
+
+template <size_t N>
+int flat_evaluate_fixed(const FlatView& view, uint32_t list, const std::array<int, N>& args);
+
+// Rebuilds the TermNode form of a list (used by Tasks 3-5)
+std::vector<TermNode> flat_to_terms(const FlatView& view, uint32_t list);
+
+#endif  //__FLATPOLY__H__
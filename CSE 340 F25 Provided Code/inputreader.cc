@@ -0,0 +1,89 @@
+/*
+ * Reader of the INPUTS section for streaming execution
+ */
+#include <string>
+
+#include "inputreader.h"
+
+using namespace std;
+
+InputReader::InputReader(LexicalAnalyzer& lexer)
+    : lexer(lexer), done(false), discard(false), valid(false), position(0), value_count(0), waits(0)
+{
+    reader = thread(&InputReader::read, this);
+}
+
+InputReader::~InputReader()
+{
+    if (reader.joinable()) {
+        finish();
+    }
+}
+
+// inputs_section → INPUTS num_list, with INPUTS already consumed
+void InputReader::read()
+{
+    vector<int> block;
+    uint64_t count = 0;
+    Token token = lexer.ScanToken();
+    while (token.token_type == NUM) {
+        block.push_back(stoi(token.lexeme));
+        count++;
+        if (block.size() == INPUT_BLOCK_SIZE) {
+            push(block);
+        }
+        token = lexer.ScanToken();
+    }
+    if (!block.empty()) {
+        push(block);
+    }
+
+    lock_guard<mutex> guard(lock);
+    value_count = count;
+    valid = (count > 0 && token.token_type == END_OF_FILE);
+    done = true;
+    changed.notify_all();
+}
+
+void InputReader::push(vector<int>& block)
+{
+    unique_lock<mutex> guard(lock);
+    if (queue.size() >= INPUT_QUEUE_BLOCKS && !discard) {
+        waits++;
+        changed.wait(guard, [this] { return queue.size() < INPUT_QUEUE_BLOCKS || discard; });
+    }
+    if (!discard) {
+        queue.push_back(move(block));
+        changed.notify_all();
+    }
+    block.clear();
+}
+
+bool InputReader::next(int& value)
+{
+    if (position == current.size()) {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] { return !queue.empty() || done; });
+        if (queue.empty()) {
+            return false;
+        }
+        current = move(queue.front());
+        queue.pop_front();
+        position = 0;
+        changed.notify_all();
+    }
+    value = current[position++];
+    return true;
+}
+
+bool InputReader::finish()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        discard = true;
+        queue.clear();
+        changed.notify_all();
+    }
+    reader.join();
+    return valid;
+}
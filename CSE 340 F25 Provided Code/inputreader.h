@@ -0,0 +1,60 @@
+/*
+ * Reader of the INPUTS section for streaming execution
+ */
+#ifndef __INPUT_READER__H__
+#define __INPUT_READER__H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lexer.h"
+
+// Values are handed over in blocks of this many; at most
+// INPUT_QUEUE_BLOCKS blocks wait in the queue, so memory does not grow
+// with the number of inputs
+#define INPUT_BLOCK_SIZE 4096
+#define INPUT_QUEUE_BLOCKS 16
+
+// Lexes the values of an INPUTS section on its own thread, once the parser
+// has consumed the INPUTS keyword, and hands them out in order through a
+// bounded queue. The lexer must not be used by anyone else until finish().
+class InputReader {
+  public:
+    explicit InputReader(LexicalAnalyzer& lexer);
+    ~InputReader();
+    InputReader(const InputReader&) = delete;
+    InputReader& operator=(const InputReader&) = delete;
+
+    // Next value of the section; false once all values have been taken
+    bool next(int& value);
+
+    // Reads the rest of the section, dropping its values, and returns true
+    // if the section is a valid num_list followed by the end of the input
+    bool finish();
+
+    uint64_t values_read() const { return value_count; }
+    uint64_t reader_waits() const { return waits; }
+
+  private:
+    void read();
+    void push(std::vector<int>& block);
+
+    LexicalAnalyzer& lexer;
+    std::thread reader;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<int>> queue;
+    bool done;                 // the reader has reached the end of the section
+    bool discard;              // finish() was called: values are not queued any more
+    bool valid;                // set with done
+    std::vector<int> current;  // block being taken from by next()
+    size_t position;
+    uint64_t value_count;      // written by the reader, read after finish()
+    uint64_t waits;            // times the reader waited for a full queue
+};
+
+#endif  //__INPUT_READER__H__
@@ -0,0 +1,217 @@
+/*
+ * Native code for polynomial bodies
+ *
+ * The code is generated like that of a stack machine: every list, term and
+ * factor leaves its value in eax, and partial results wait on the stack
+ * while the next operand is computed. rdi holds the argument array and is
+ * never changed; ecx and edx are scratch. Nothing is called, so the stack
+ * needs no alignment.
+ */
+#include <cstring>
+
+#include "jit.h"
+#include "parser.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64 1
+#else
+#define JIT_X86_64 0
+#endif
+
+using namespace std;
+
+bool jit_supported()
+{
+    return JIT_X86_64;
+}
+
+PolyJit::PolyJit(int decl_count, uint32_t threshold)
+    : threshold(threshold < 1 ? 1 : threshold),
+      calls(new atomic<uint32_t>[decl_count]),
+      functions(new atomic<JitFunction>[decl_count]),
+      compiled_count(0), total_code_bytes(0)
+{
+    for (int i = 0; i < decl_count; i++) {
+        calls[i].store(0, memory_order_relaxed);
+        functions[i].store(nullptr, memory_order_relaxed);
+    }
+}
+
+PolyJit::~PolyJit()
+{
+#if JIT_X86_64
+    for (auto& region : regions) {
+        munmap(region.first, region.second);
+    }
+#endif
+}
+
+JitFunction PolyJit::function(int handle, const FlatView& view, uint32_t list)
+{
+    JitFunction function = functions[handle].load(memory_order_acquire);
+    if (function) {
+        return function;
+    }
+    // Only the call that reaches the threshold compiles
+    if (calls[handle].fetch_add(1, memory_order_relaxed) + 1 != threshold) {
+        return nullptr;
+    }
+    function = compile(view, list);
+    functions[handle].store(function, memory_order_release);
+    return function;
+}
+
+#if JIT_X86_64
+
+namespace {
+
+class CodeBuffer {
+  public:
+    vector<uint8_t> bytes;
+    bool too_large = false;
+
+    void emit(initializer_list<uint8_t> code)
+    {
+        bytes.insert(bytes.end(), code);
+        too_large = too_large || bytes.size() > JIT_MAX_CODE_BYTES;
+    }
+    void emit32(uint32_t value)
+    {
+        emit({(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)});
+    }
+
+    void mov_eax_imm(int32_t value) { emit({0xB8}); emit32(value); }
+    void mov_edx_arg(uint32_t index) { emit({0x8B, 0x97}); emit32(index * 4); }  // mov edx, [rdi + 4 * index]
+    void neg_eax()          { emit({0xF7, 0xD8}); }
+    void push_rax()         { emit({0x50}); }
+    void pop_rcx()          { emit({0x59}); }
+    void add_eax_ecx()      { emit({0x01, 0xC8}); }
+    void sub_ecx_eax()      { emit({0x29, 0xC1}); }  // ecx -= eax
+    void mov_eax_ecx()      { emit({0x89, 0xC8}); }
+    void imul_eax_ecx()     { emit({0x0F, 0xAF, 0xC1}); }
+    void imul_eax_edx()     { emit({0x0F, 0xAF, 0xC2}); }
+    void imul_edx_edx()     { emit({0x0F, 0xAF, 0xD2}); }
+    void ret()              { emit({0xC3}); }
+};
+
+void emit_list(CodeBuffer& code, const FlatView& view, uint32_t list);
+
+// eax = coefficient * args[0]^e0 * args[1]^e1 ..., powers by repeated
+// squaring, which gives the same product modulo 2^32 as flat_evaluate()
+void emit_monomial(CodeBuffer& code, const FlatView& view, const FlatTerm& term)
+{
+    code.mov_eax_imm(term.coefficient);
+    for (uint32_t i = 0; i < term.count; i++) {
+        int32_t power = view.exps[term.first + i];
+        if (power <= 0) {
+            continue;
+        }
+        code.mov_edx_arg(i);
+        while (true) {
+            if (power & 1) {
+                code.imul_eax_edx();
+            }
+            power >>= 1;
+            if (power == 0) {
+                break;
+            }
+            code.imul_edx_edx();
+        }
+    }
+}
+
+// eax = product of the factors; like flat_evaluate(), the coefficient of a
+// parenthesized term is not used
+void emit_factors(CodeBuffer& code, const FlatView& view, const FlatTerm& term)
+{
+    if (term.count == 0) {
+        code.mov_eax_imm(1);
+        return;
+    }
+    emit_list(code, view, term.first);
+    for (uint32_t i = 1; i < term.count; i++) {
+        code.push_rax();
+        emit_list(code, view, term.first + i);
+        code.pop_rcx();
+        code.imul_eax_ecx();
+    }
+}
+
+void emit_term(CodeBuffer& code, const FlatView& view, const FlatTerm& term)
+{
+    if (term.kind == MLIST) {
+        emit_monomial(code, view, term);
+    } else {
+        emit_factors(code, view, term);
+    }
+}
+
+// eax = sum of the terms with their signs
+void emit_list(CodeBuffer& code, const FlatView& view, uint32_t list)
+{
+    const FlatList& range = view.lists[list];
+    if (range.term_count == 0) {
+        code.mov_eax_imm(0);
+        return;
+    }
+    for (uint32_t i = 0; i < range.term_count && !code.too_large; i++) {
+        const FlatTerm& term = view.terms[range.first_term + i];
+        if (i > 0) {
+            code.push_rax();
+        }
+        emit_term(code, view, term);
+        if (i == 0) {
+            if (term.op == OP_MINUS) {
+                code.neg_eax();
+            }
+        } else if (term.op == OP_PLUS) {
+            code.pop_rcx();
+            code.add_eax_ecx();
+        } else {
+            code.pop_rcx();
+            code.sub_ecx_eax();
+            code.mov_eax_ecx();
+        }
+    }
+}
+
+}
+
+JitFunction PolyJit::compile(const FlatView& view, uint32_t list)
+{
+    CodeBuffer code;
+    emit_list(code, view, list);
+    code.ret();
+    if (code.too_large) {
+        return nullptr;
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (code.bytes.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    memcpy(memory, code.bytes.data(), code.bytes.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+
+    lock_guard<mutex> guard(lock);
+    regions.emplace_back(memory, size);
+    compiled_count++;
+    total_code_bytes += code.bytes.size();
+    return (JitFunction)memory;
+}
+
+#else
+
+JitFunction PolyJit::compile(const FlatView&, uint32_t)
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Native code for polynomial bodies (x86-64 Linux; elsewhere the
+ * interpreter, flat_evaluate(), is always used)
+ */
+#ifndef __JIT__H__
+#define __JIT__H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "flatpoly.h"
+
+// Compiled body: takes the argument values, one per parameter, and returns
+// what flat_evaluate() returns for them (int arithmetic wrapping around)
+typedef int (*JitFunction)(const int* args);
+
+// Bodies whose code would be larger than this are left to the interpreter
+#define JIT_MAX_CODE_BYTES (64u << 20)
+
+bool jit_supported();
+
+// Compiles the body of a declaration once it has been called `threshold`
+// times. Can be used from several threads: one call compiles, the others
+// keep interpreting until the code is ready.
+class PolyJit {
+  public:
+    PolyJit(int decl_count, uint32_t threshold);
+    ~PolyJit();
+    PolyJit(const PolyJit&) = delete;
+    PolyJit& operator=(const PolyJit&) = delete;
+
+    // Native function of the declaration with this handle, or nullptr while
+    // it has been called fewer than `threshold` times or cannot be compiled
+    JitFunction function(int handle, const FlatView& view, uint32_t list);
+
+    int compiled() const { return compiled_count; }
+    size_t code_bytes() const { return total_code_bytes; }
+
+  private:
+    JitFunction compile(const FlatView& view, uint32_t list);
+
+    uint32_t threshold;
+    std::unique_ptr<std::atomic<uint32_t>[]> calls;
+    std::unique_ptr<std::atomic<JitFunction>[]> functions;
+    std::mutex lock;                                  // guards the members below
+    std::vector<std::pair<void*, size_t>> regions;    // mapped code
+    int compiled_count;
+    size_t total_code_bytes;
+};
+
+#endif  //__JIT__H__
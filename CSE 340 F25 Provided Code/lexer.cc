@@ -8,6 +8,8 @@
 #include <vector>
 #include <string>
 #include <cctype>
+#include <cstdio>
+#include <thread>
 
 #include "lexer.h"
 #include "inputbuf.h"
@@ -32,24 +34,221 @@ void Token::Print()
 // The constructor function will get all token in the input and stores them in an
 // internal vector. This faciliates the implementation of peek()
 LexicalAnalyzer::LexicalAnalyzer()
+{
+    Tokenize(END_OF_FILE);
+}
+
+// Same as above, but the tokens are read from the given stream instead of
+// standard input (used when several programs are processed in one run)
+LexicalAnalyzer::LexicalAnalyzer(istream& in) : input(in)
+{
+    Tokenize(END_OF_FILE);
+}
+
+// Only the tokens up to and including the first `stop` token are stored;
+// the rest of the stream is left unread, for ScanToken() (used to read the
+// INPUTS section while the program runs, see Parser::parse_program_streaming())
+LexicalAnalyzer::LexicalAnalyzer(istream& in, TokenType stop) : input(in)
+{
+    Tokenize(stop);
+}
+
+// Chunks of the source lexed in parallel are at least this long
+#define LEX_MIN_CHUNK (1 << 16)
+
+// Tokenizes source on up to `threads` threads, with the same tokens and
+// line numbers as the stream constructor. The source is split in chunks
+// that start at a whitespace character, which no token spans, and each
+// chunk is lexed with line numbers counted from its start; the lines
+// counted in the chunks before it are then added.
+LexicalAnalyzer::LexicalAnalyzer(const string& source, int threads)
+{
+    const char* data = source.data();
+    size_t size = source.size();
+    int chunk_count = 1;
+    if (threads > 1) {
+        chunk_count = (int)min<size_t>(threads, size / LEX_MIN_CHUNK + 1);
+    }
+
+    // A chunk must not start right after a character that is dropped when
+    // it is put back (see ScanChunk())
+    vector<size_t> bounds(1, 0);
+    for (int i = 1; i < chunk_count; i++) {
+        size_t split = max(size * i / chunk_count, bounds.back() + 1);
+        while (split < size && !(isspace(data[split]) && data[split - 1] != EOF)) {
+            split++;
+        }
+        if (split >= size) {
+            break;
+        }
+        bounds.push_back(split);
+    }
+    bounds.push_back(size);
+    chunk_count = bounds.size() - 1;
+
+    vector<vector<Token>> chunks(chunk_count);
+    vector<int> newlines(chunk_count, 0);
+    bool trailing_newline = false;
+    vector<thread> workers;
+    for (int i = 1; i < chunk_count; i++) {
+        workers.emplace_back([&, i] {
+            bool ends_in_newline = ScanChunk(data + bounds[i], data + bounds[i + 1], chunks[i], newlines[i]);
+            if (i == chunk_count - 1) trailing_newline = ends_in_newline;
+        });
+    }
+    bool ends_in_newline = ScanChunk(data + bounds[0], data + bounds[1], chunks[0], newlines[0]);
+    if (chunk_count == 1) trailing_newline = ends_in_newline;
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    size_t token_count = 0;
+    for (const vector<Token>& chunk : chunks) {
+        token_count += chunk.size();
+    }
+    tokenList.reserve(token_count);
+    int first_line = 1;
+    for (int i = 0; i < chunk_count; i++) {
+        for (Token& token : chunks[i]) {
+            token.line_no += first_line;
+            tokenList.push_back(move(token));
+        }
+        vector<Token>().swap(chunks[i]);
+        first_line += newlines[i];
+    }
+
+    // SkipSpace() counts the last newline of trailing whitespace twice: the
+    // read that fails at the end of the input leaves it in place
+    line_no = first_line + (trailing_newline ? 1 : 0);
+    tmp.lexeme = "";
+    tmp.line_no = 1;
+    tmp.token_type = ERROR;
+    index = 0;
+}
+
+// Lexes [begin, end) the way GetTokenMain() lexes a stream, including what
+// it does with a character equal to EOF: UngetChar() drops it, so it is
+// skipped where it would be put back and the character after it is taken
+// as is, even a space. Line numbers start at 0; newlines counts the lines
+// that SkipSpace() would count. Returns true if the chunk ends with a
+// newline skipped as whitespace.
+bool LexicalAnalyzer::ScanChunk(const char* begin, const char* end, vector<Token>& tokens, int& newlines)
+{
+    const char* p = begin;
+    int line = 0;
+    bool skipped_to_newline = false;
+    while (true) {
+        const char* space = p;
+        while (p < end && isspace(*p)) {
+            line += (*p == '\n');
+            p++;
+        }
+        skipped_to_newline = (p == end && p > space && p[-1] == '\n');
+        if (p < end && *p == EOF) {
+            p++; // put back by SkipSpace()
+        }
+        if (p == end) {
+            break;
+        }
+
+        Token token;
+        token.line_no = line;
+        char c = *p++;
+        switch (c) {
+            case ';': token.token_type = SEMICOLON; break;
+            case '^': token.token_type = POWER;     break;
+            case '-': token.token_type = MINUS;     break;
+            case '+': token.token_type = PLUS;      break;
+            case '=': token.token_type = EQUAL;     break;
+            case '(': token.token_type = LPAREN;    break;
+            case ')': token.token_type = RPAREN;    break;
+            case ',': token.token_type = COMMA;     break;
+            default:
+                if (isdigit(c)) {
+                    token.token_type = NUM;
+                    if (c == '0') {
+                        token.lexeme = "0";
+                        break;
+                    }
+                    const char* start = p - 1;
+                    while (p < end && isdigit(*p)) p++;
+                    token.lexeme.assign(start, p);
+                    if (p < end && *p == EOF) p++; // put back by ScanNumber()
+                } else if (isalpha(c)) {
+                    const char* start = p - 1;
+                    while (p < end && isalnum(*p)) p++;
+                    token.lexeme.assign(start, p);
+                    token.token_type = IsKeyword(token.lexeme) ? FindKeywordIndex(token.lexeme) : ID;
+                    if (p < end && *p == EOF) p++; // put back by ScanIdOrKeyword()
+                } else {
+                    token.token_type = ERROR;
+                }
+                break;
+        }
+        tokens.push_back(move(token));
+    }
+    newlines = line;
+    return skipped_to_newline;
+}
+
+// Returns tokens [begin, end) of another lexer's list, which is not copied
+// and must outlive this lexer; END_OF_FILE follows, on the line of the last
+// token. Used to parse part of a program on its own, concurrently with
+// other parts (see Parser::parse_poly_decl_list_parallel()).
+LexicalAnalyzer::LexicalAnalyzer(const LexicalAnalyzer& source, int begin, int end)
+    : shared(&source.Tokens()), shared_end(end)
+{
+    line_no = end > begin ? (*shared)[end - 1].line_no : source.line_no;
+    tmp.lexeme = "";
+    tmp.line_no = 1;
+    tmp.token_type = ERROR;
+    index = begin;
+}
+
+void LexicalAnalyzer::Tokenize(TokenType stop)
 {
     this->line_no = 1;
     tmp.lexeme = "";
     tmp.line_no = 1;
     tmp.token_type = ERROR;
 
-    Token token = GetTokenMain();
     index = 0;
+    ScanTokens(stop);
+}
+
+// Lexes another stream and appends its tokens to the list; line numbers
+// continue from first_line. Used to lex a program in pieces when part of it
+// does not need to be lexed (see polycache.h)
+void LexicalAnalyzer::Append(istream& in, int first_line)
+{
+    input = InputBuffer(in);
+    this->line_no = first_line;
+    ScanTokens(END_OF_FILE);
+}
+
+void LexicalAnalyzer::ScanTokens(TokenType stop)
+{
+    Token token = GetTokenMain();
 
     while (token.token_type != END_OF_FILE)
     {
         tokenList.push_back(token);     // push token into internal list
+        if (token.token_type == stop) {
+            break;
+        }
         token = GetTokenMain();        // and get next token from standatd input
     }
     // pushes END_OF_FILE is not pushed on the token list
 
 }
 
+// Lexes the next token of the part of the stream that was not tokenized;
+// the token is not stored
+Token LexicalAnalyzer::ScanToken()
+{
+    return GetTokenMain();
+}
+
 bool LexicalAnalyzer::SkipSpace()
 {
     char c;
@@ -152,18 +351,41 @@ Token LexicalAnalyzer::ScanIdOrKeyword()
     return tmp;
 }
 
+// All tokens, including those already returned by GetToken()
+const vector<Token>& LexicalAnalyzer::Tokens() const
+{
+    return shared ? *shared : tokenList;
+}
+
+// Position after the last token GetToken() returns
+int LexicalAnalyzer::End() const
+{
+    return shared ? shared_end : (int)tokenList.size();
+}
+
+// Index in Tokens() of the token GetToken() returns next
+int LexicalAnalyzer::Position() const
+{
+    return index;
+}
+
+void LexicalAnalyzer::Seek(int position)
+{
+    index = position;
+}
+
 // GetToken() accesses tokens from the tokenList that is populated when a 
 // lexer object is instantiated
 Token LexicalAnalyzer::GetToken()
 {
     Token token;
-    if (index == tokenList.size()){       // return end of file if
+    if (index == End()){                  // return end of file if
         token.lexeme = "";                // index is too large
         token.line_no = line_no;
         token.token_type = END_OF_FILE;
     }
     else{
-        token = tokenList[index];
+        token = Tokens()[index];
         index = index + 1;
     }
     return token;
@@ -180,14 +402,14 @@ Token LexicalAnalyzer::peek(int howFar)
     } 
 
     int peekIndex = index + howFar - 1;
-    if (peekIndex > (tokenList.size()-1)) { // if peeking too far
+    if (peekIndex >= End()) {               // if peeking too far
         Token token;                        // return END_OF_FILE
         token.lexeme = "";
         token.line_no = line_no;
         token.token_type = END_OF_FILE;
         return token;
     } else
-        return tokenList[peekIndex];
+        return Tokens()[peekIndex];
 }
 
 Token LexicalAnalyzer::GetTokenMain()
@@ -6,6 +6,7 @@
 #ifndef __LEXER__H__
 #define __LEXER__H__
 
+#include <istream>
 #include <vector>
 #include <string>
 
@@ -34,9 +35,24 @@ class LexicalAnalyzer {
     Token GetToken();
     Token peek(int);
     LexicalAnalyzer();
+    explicit LexicalAnalyzer(std::istream& in);
+    LexicalAnalyzer(std::istream& in, TokenType stop);
+    LexicalAnalyzer(const std::string& source, int threads);
+    LexicalAnalyzer(const LexicalAnalyzer& source, int begin, int end);
+    void Append(std::istream& in, int first_line);
+    Token ScanToken();
+    const std::vector<Token>& Tokens() const;
+    int Position() const;
+    void Seek(int position);
 
   private:
     std::vector<Token> tokenList;
+    const std::vector<Token>* shared = nullptr;  // list of another lexer this one reads a range of
+    int shared_end = 0;
+    int End() const;
+    void Tokenize(TokenType stop);
+    void ScanTokens(TokenType stop);
+    bool ScanChunk(const char* begin, const char* end, std::vector<Token>& tokens, int& newlines);
     Token GetTokenMain();
     int line_no;
     int index;
@@ -0,0 +1,239 @@
+/*
+ * Command line entry point
+ *
+ *   a.out [OPTION...]                   read one program from standard input
+ *   a.out [OPTION...] --poly-cache FILE same, but keep the validated POLY
+ *                                       section in a binary cache FILE and
+ *                                       reuse it while it is up to date
+ *   a.out [OPTION...] --stream-inputs   same, but run Task 2 while the INPUTS
+ *                                       section is being read instead of
+ *                                       keeping all of its values in memory
+ *   a.out [OPTION...] --batch [-j N] [-o DIR] FILE...
+ *                                       run every FILE in one process; with no
+ *                                       FILE the list is read from standard
+ *                                       input, one path per line
+ *   a.out [OPTION...] --serve POLYFILE [--socket PATH]
+ *                                       keep the POLY section in POLYFILE
+ *                                       loaded and answer EXECUTE/INPUTS
+ *                                       requests (see server.h)
+ *
+ * Options:
+ *   --task5-memory SIZE                 expand Task 5 declarations estimated to
+ *                                       need more than SIZE bytes (K, M, G
+ *                                       suffixes) within that budget, spilling
+ *                                       to temporary files as needed
+ *   --task5-max-terms N                 do not expand declarations that can
+ *                                       produce more than N terms
+ *   --threads N                         use N threads for large Task 5
+ *                                       multiplications
+ *   --mult-order left|planned           order of factor multiplication in
+ *                                       Task 5 (default planned)
+ *   --mult auto|schoolbook|dense        how Task 5 multiplies two term lists;
+ *                                       auto uses dense multiplication when
+ *                                       it is estimated to be cheaper
+ *   --no-expansion-cache                expand every parenthesized term in
+ *                                       Task 5 even if an identical one was
+ *                                       already expanded
+ *   --term-sort keyed|comparison        how Task 5 sorts expanded terms
+ *                                       (default keyed, see sort_terms())
+ *   --parallel-execute                  run independent Task 2 statements on
+ *                                       the --threads threads
+ *   --parallel-poly                     parse the POLY declarations on the
+ *                                       --threads threads
+ *   --keep-dead-assignments             evaluate every assignment in Task 2,
+ *                                       including those whose value is never
+ *                                       output
+ *   --lex-threads N                     read the whole program into memory and
+ *                                       lex it on N threads
+ *   --no-cse-plans                      evaluate every monomial of a body on
+ *                                       its own in Task 2 instead of sharing
+ *                                       the products common to several
+ *   --no-arity-specialization           evaluate every declaration with the
+ *                                       generic evaluator, whatever its number
+ *                                       of parameters
+ *   --jit N                             compile a declaration to native code
+ *                                       once Task 2 has evaluated it N times
+ *                                       (x86-64 Linux only)
+ *   --jit-verify                        also interpret every compiled call and
+ *                                       report results that differ
+ *   --profile                           run Task 2 sequentially and write
+ *                                       calls and times of every declaration
+ *                                       and the slowest statements to
+ *                                       standard error
+ *   --check                             only check the program for syntax
+ *                                       and semantic errors, as Task 1 does,
+ *                                       and run none of its tasks
+ *   --stats                             write statistics to standard error
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "parser.h"
+#include "batch.h"
+#include "server.h"
+
+using namespace std;
+
+enum RunMode { MODE_SINGLE, MODE_BATCH, MODE_SERVE };
+
+static int usage()
+{
+    cerr << "usage: a.out [OPTION...] [--poly-cache FILE | --stream-inputs]\n"
+         << "       a.out [OPTION...] --batch [-j N] [-o DIR] [FILE...]\n"
+         << "       a.out [OPTION...] --serve POLYFILE [--socket PATH]\n"
+         << "options: --task5-memory SIZE --task5-max-terms N --threads N\n"
+         << "         --mult-order left|planned --mult auto|schoolbook|dense\n"
+         << "         --no-expansion-cache --term-sort keyed|comparison\n"
+         << "         --parallel-execute --parallel-poly --keep-dead-assignments\n"
+         << "         --lex-threads N --no-cse-plans --no-arity-specialization\n"
+         << "         --jit N --jit-verify --profile --check --stats\n";
+    return 2;
+}
+
+// "64M" → 67108864; returns false if the text is not a size
+static bool parse_size(const string& text, size_t& size)
+{
+    char* end;
+    unsigned long long value = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) return false;
+    string suffix = end;
+    if (suffix == "K" || suffix == "k") value <<= 10;
+    else if (suffix == "M" || suffix == "m") value <<= 20;
+    else if (suffix == "G" || suffix == "g") value <<= 30;
+    else if (!suffix.empty()) return false;
+    size = value;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    RunMode mode = MODE_SINGLE;
+    ParserOptions options;
+    string poly_cache, poly_file, socket_path, output_dir;
+    bool stream_inputs = false;
+    int jobs = 1;
+    vector<string> input_files;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--batch") {
+            mode = MODE_BATCH;
+        } else if (arg == "--serve" && has_value) {
+            mode = MODE_SERVE;
+            poly_file = argv[++i];
+        } else if (arg == "--socket" && has_value) {
+            socket_path = argv[++i];
+        } else if (arg == "--poly-cache" && has_value) {
+            poly_cache = argv[++i];
+        } else if (arg == "--stream-inputs") {
+            stream_inputs = true;
+        } else if (arg == "-j" && has_value) {
+            jobs = atoi(argv[++i]);
+        } else if (arg == "-o" && has_value) {
+            output_dir = argv[++i];
+        } else if (arg == "--task5-memory" && has_value) {
+            if (!parse_size(argv[++i], options.task5_memory_budget)) return usage();
+        } else if (arg == "--task5-max-terms" && has_value) {
+            options.task5_max_terms = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--lex-threads" && has_value) {
+            options.lex_threads = atoi(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            options.threads = atoi(argv[++i]);
+        } else if (arg == "--mult-order" && has_value) {
+            string order = argv[++i];
+            if (order == "left") options.mult_order = MULT_ORDER_LEFT;
+            else if (order == "planned") options.mult_order = MULT_ORDER_PLANNED;
+            else return usage();
+        } else if (arg == "--mult" && has_value) {
+            string engine = argv[++i];
+            if (engine == "auto") options.mult_engine = MULT_AUTO;
+            else if (engine == "schoolbook") options.mult_engine = MULT_SCHOOLBOOK;
+            else if (engine == "dense") options.mult_engine = MULT_DENSE;
+            else return usage();
+        } else if (arg == "--term-sort" && has_value) {
+            string sort = argv[++i];
+            if (sort == "keyed") options.term_sort = TERM_SORT_KEYED;
+            else if (sort == "comparison") options.term_sort = TERM_SORT_COMPARISON;
+            else return usage();
+        } else if (arg == "--no-expansion-cache") {
+            options.cache_expansions = false;
+        } else if (arg == "--parallel-execute") {
+            options.parallel_execute = true;
+        } else if (arg == "--parallel-poly") {
+            options.parallel_poly = true;
+        } else if (arg == "--keep-dead-assignments") {
+            options.skip_dead_assignments = false;
+        } else if (arg == "--jit" && has_value) {
+            options.jit_threshold = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--no-cse-plans") {
+            options.cse_plans = false;
+        } else if (arg == "--no-arity-specialization") {
+            options.specialize_arity = false;
+        } else if (arg == "--jit-verify") {
+            options.jit_verify = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--check") {
+            options.check_only = true;
+        } else if (arg == "--stats") {
+            options.print_stats = true;
+        } else if (mode == MODE_BATCH && !arg.empty() && arg[0] != '-') {
+            input_files.push_back(arg);
+        } else {
+            return usage();
+        }
+    }
+
+    if (mode == MODE_SERVE) {
+        return run_server(poly_file, socket_path, options);
+    }
+
+    if (mode == MODE_BATCH) {
+        if (input_files.empty()) {
+            string line;
+            while (getline(cin, line)) {
+                if (!line.empty()) {
+                    input_files.push_back(line);
+                }
+            }
+        }
+        return run_batch(input_files, output_dir, jobs, options);
+    }
+
+    if (stream_inputs) {
+        if (!poly_cache.empty()) return usage();
+        istringstream no_input;
+        Parser parser(no_input, cout);
+        parser.set_options(options);
+        return parser.parse_program_streaming(cin) == PARSE_OK ? 0 : 1;
+    }
+
+    if (!poly_cache.empty()) {
+        stringstream source;
+        source << cin.rdbuf();
+        istringstream no_input;
+        Parser parser(no_input, cout);
+        parser.set_options(options);
+        return parser.parse_program_with_cache(source.str(), poly_cache) == PARSE_OK ? 0 : 1;
+    }
+
+    if (options.lex_threads > 0) {
+        string source;
+        char buffer[1 << 16];
+        while (cin.read(buffer, sizeof buffer) || cin.gcount() > 0) {
+            source.append(buffer, cin.gcount());
+        }
+        istringstream no_input;
+        Parser parser(no_input, cout);
+        parser.set_options(options);
+        return parser.parse_program_source(source) == PARSE_OK ? 0 : 1;
+    }
+
+    Parser parser;
+    parser.set_options(options);
+    return parser.parse_program() == PARSE_OK ? 0 : 1;
+}
@@ -8,17 +8,64 @@
  *
  */
 #include <iostream>
+#include <sstream>
 #include <cstdlib>
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <unordered_map>
 #include "parser.h"
+#include "polylib.h"
+#include "polycache.h"
+#include "spill.h"
+#include "dense.h"
+#include "workpool.h"
+#include "inputreader.h"
+#include "jit.h"
+#include "evalplan.h"
+#include "profiler.h"
 
 using namespace std;
 
+Parser::Parser() : out(&cout), resident_polys(nullptr), poly_cache(nullptr), poly_cache_line(0),
+                   expansion_cache(nullptr), current_decl(-1), forms_reused(0), input_reader(nullptr), eval_state(nullptr),
+                   jit(nullptr), profiler(nullptr)
+{
+}
+
+Parser::Parser(istream& in, ostream& out)
+    : lexer(in), out(&out), resident_polys(nullptr), poly_cache(nullptr), poly_cache_line(0),
+      expansion_cache(nullptr), current_decl(-1), forms_reused(0), input_reader(nullptr), eval_state(nullptr), jit(nullptr),
+      profiler(nullptr)
+{
+}
+
+Parser::~Parser()
+{
+    clear_program();
+}
+
+void Parser::set_options(const ParserOptions& options)
+{
+    this->options = options;
+}
+
+void Parser::reset(istream& in, ostream& out)
+{
+    clear_program();
+    lexer = LexicalAnalyzer(in);
+    this->out = &out;
+}
+
 // You should provide the syntax error message for this function
 void Parser::syntax_error()
 {
-    cout << "SYNTAX ERROR !!!!!&%!!!!&%!!!!!!" << endl;
-    exit(1);
+    *out << "SYNTAX ERROR !!!!!&%!!!!&%!!!!!!" << endl;
+    throw SyntaxError();
 }
 
 // this function gets a token and checks if it is
@@ -38,45 +85,303 @@ Token Parser::expect(TokenType expected_type)
 // Parsing
 
 // program → tasks_section poly_section execute_section inputs_section
-void Parser::parse_program()
+ParseStatus Parser::parse_program()
+{
+    clear_state();
+    
+    auto start = chrono::steady_clock::now();
+    int lines;
+    try {
+        parse_tasks_section();
+        plan_ir();
+        parse_poly_section();
+        parse_execute_section();
+        parse_inputs_section();
+        lines = expect(END_OF_FILE).line_no;
+    } catch (const SyntaxError&) {
+        return PARSE_SYNTAX_ERROR;
+    }
+    
+    // Check for semantic errors and output if found
+    check_semantic_errors();
+    if (options.print_stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "stats: parse lines=" << lines << " ms=" << (long)ms
+             << " lines-per-second=" << (long)(ms > 0 ? lines * 1000.0 / ms : 0)
+             << " bodies=" << build_bodies << " program=" << build_program
+             << " inputs=" << build_inputs << endl;
+    }
+    if (has_semantic_errors) {
+        output_semantic_errors();
+        return PARSE_SEMANTIC_ERROR; // Stop if there are semantic errors
+    }
+    
+    // If no semantic errors, execute requested tasks
+    if (!options.check_only) {
+        execute_tasks();
+    }
+    return PARSE_OK;
+}
+
+// Called once the TASKS section is parsed: only Task 2 needs the statements
+// and inputs, and only Tasks 2-5 need the declaration bodies. Without them
+// the rest of the program is parsed by the plain grammar functions, which
+// only record what the semantic checks use.
+void Parser::plan_ir()
+{
+    bool run = !options.check_only;
+    bool task2 = run && requested_tasks.count(2);
+    build_bodies = task2 || (run && (requested_tasks.count(3) || requested_tasks.count(4) ||
+                                     requested_tasks.count(5)));
+    build_program = task2;
+    build_inputs = task2;
+}
+
+// Same as parse_program() for the program in `source`, which is lexed on
+// options.lex_threads threads
+ParseStatus Parser::parse_program_source(const std::string& source)
+{
+    auto start = chrono::steady_clock::now();
+    lexer = LexicalAnalyzer(source, options.lex_threads);
+    if (options.print_stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "stats: lex bytes=" << source.size() << " threads=" << options.lex_threads
+             << " ms=" << (long)ms << endl;
+    }
+    return parse_program();
+}
+
+// Same as parse_program() for the program read from `in`, except that Task 2
+// runs while the INPUTS section is being read: the lexer stops after the
+// INPUTS keyword and an InputReader lexes the values into a bounded queue
+// that INPUT statements take them from, so they are never all in memory.
+// Semantic errors are all known before INPUTS and stop execution as usual.
+// The output of Task 2 is held back until the whole section has been read,
+// since a syntax error in it must still suppress all other output.
+ParseStatus Parser::parse_program_streaming(std::istream& in)
+{
+    clear_state();
+    lexer = LexicalAnalyzer(in, INPUTS);
+    
+    try {
+        parse_tasks_section();
+        plan_ir();
+        parse_poly_section();
+        parse_execute_section();
+        expect(INPUTS);
+    } catch (const SyntaxError&) {
+        return PARSE_SYNTAX_ERROR;
+    }
+    check_semantic_errors();
+    
+    auto start = chrono::steady_clock::now();
+    InputReader reader(lexer);
+    ostringstream task2_output;
+    bool run_task2 = !has_semantic_errors && !options.check_only && requested_tasks.count(2);
+    if (run_task2) {
+        ostream* program_output = out;
+        out = &task2_output;
+        input_reader = &reader;
+        execute_task_2();
+        input_reader = nullptr;
+        out = program_output;
+    }
+    bool valid = reader.finish();
+    if (options.print_stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "stats: streamed inputs values=" << reader.values_read()
+             << " reader-waits=" << reader.reader_waits() << " ms=" << (long)ms << endl;
+    }
+    
+    try {
+        if (!valid) {
+            syntax_error();
+        }
+    } catch (const SyntaxError&) {
+        return PARSE_SYNTAX_ERROR;
+    }
+    if (has_semantic_errors) {
+        output_semantic_errors();
+        return PARSE_SEMANTIC_ERROR;
+    }
+    if (options.check_only) {
+        return PARSE_OK;
+    }
+    
+    *out << task2_output.str();
+    requested_tasks.erase(2); // already run
+    execute_tasks();
+    return PARSE_OK;
+}
+
+// Same as parse_program() for the program in `source`, except that the
+// POLY section is taken from the binary cache at cache_path if the cache
+// was built from the same section text; otherwise the cache is rewritten
+// after parsing (see polycache.h)
+ParseStatus Parser::parse_program_with_cache(const std::string& source, const std::string& cache_path)
+{
+    size_t begin, end;
+    if (!find_poly_section(source, begin, end)) {
+        istringstream in(source);
+        lexer = LexicalAnalyzer(in);
+        return parse_program();
+    }
+    uint64_t hash = hash_poly_source(source.data() + begin, end - begin);
+    int section_line = 1 + (int)std::count(source.begin(), source.begin() + begin, '\n');
+    
+    PolyCache cache;
+    if (cache.open(cache_path, hash)) {
+        // Lex everything except the declarations
+        istringstream head(source.substr(0, begin));
+        istringstream tail(source.substr(end));
+        lexer = LexicalAnalyzer(head);
+        lexer.Append(tail, section_line + (int)std::count(source.begin() + begin, source.begin() + end, '\n'));
+        
+        poly_cache = &cache;
+        poly_cache_line = section_line;
+        ParseStatus status = parse_program();
+        poly_cache = nullptr;
+        return status;
+    }
+    
+    istringstream in(source);
+    lexer = LexicalAnalyzer(in);
+    ParseStatus status = parse_program();
+    if (status != PARSE_SYNTAX_ERROR && build_bodies && poly_section_valid()) {
+        write_poly_cache(cache_path, hash, declarations, section_line);
+    }
+    return status;
+}
+
+// Entry point for the library API (polylib.h): the input is a POLY section
+// on its own. Semantic errors are not printed; use first_semantic_error().
+// poly_library → poly_section
+ParseStatus Parser::parse_poly_library()
+{
+    clear_state();
+    
+    try {
+        parse_poly_section();
+        expect(END_OF_FILE);
+    } catch (const SyntaxError&) {
+        return PARSE_SYNTAX_ERROR;
+    }
+    
+    check_semantic_errors();
+    return has_semantic_errors ? PARSE_SEMANTIC_ERROR : PARSE_OK;
+}
+
+// Entry point for the server (server.h): the input is one request made of
+// an EXECUTE and an INPUTS section that is run (Task 2) against the
+// polynomials passed to use_resident_polys().
+// request → execute_section inputs_section
+ParseStatus Parser::parse_request()
+{
+    clear_state();
+    
+    try {
+        parse_execute_section();
+        parse_inputs_section();
+        expect(END_OF_FILE);
+    } catch (const SyntaxError&) {
+        return PARSE_SYNTAX_ERROR;
+    }
+    
+    check_semantic_errors();
+    if (has_semantic_errors) {
+        output_semantic_errors();
+        return PARSE_SEMANTIC_ERROR;
+    }
+    
+    execute_task_2();
+    return PARSE_OK;
+}
+
+void Parser::use_resident_polys(const CompiledPolys* polys)
+{
+    resident_polys = polys;
+}
+
+void Parser::clear_state()
 {
     // Initialize semantic checking variables
-    polynomials.clear();
     duplicate_lines.clear();
     im4_errors.clear();
     aup13_errors.clear();
     na7_errors.clear();
-    current_poly = nullptr;
     has_semantic_errors = false;
+    build_bodies = build_program = build_inputs = true;
     
     // Initialize task execution variables
     requested_tasks.clear();
-    rich_polynomials.clear();
-    current_rich_poly = nullptr;
+    declarations.clear();
+    own_eval_state.reset();
+    current_decl = -1;
+    decl_forms.clear();
     
     // Initialize Task 2 variables
-    program.clear();
+    clear_program();
     symbol_table.clear();
     memory.clear();
     inputs.clear();
     next_input = 0;
     next_location = 0;
-    
-    parse_tasks_section();
-    parse_poly_section();
-    parse_execute_section();
-    parse_inputs_section();
-    expect(END_OF_FILE);
-    
-    // Check for semantic errors and output if found
-    check_semantic_errors();
-    if (has_semantic_errors) {
-        output_semantic_errors();
-        return; // Exit if there are semantic errors
+}
+
+DeclStore Parser::take_polynomials()
+{
+    DeclStore result = std::move(declarations);
+    declarations.clear();
+    own_eval_state.reset();
+    current_decl = -1;
+    return result;
+}
+
+int DeclStore::add(RichPolyDecl decl)
+{
+    if (count % CHUNK_SIZE == 0) {
+        chunks.emplace_back();
+        chunks.back().reserve(CHUNK_SIZE);
     }
-    
-    // If no semantic errors, execute requested tasks
-    execute_tasks();
+    first_by_name.emplace(decl.name, count);
+    chunks.back().push_back(std::move(decl));
+    return count++;
+}
+
+int DeclStore::find(const std::string& name) const
+{
+    auto it = first_by_name.find(name);
+    return it == first_by_name.end() ? -1 : it->second;
+}
+
+void DeclStore::clear()
+{
+    chunks.clear();
+    first_by_name.clear();
+    count = 0;
+}
+
+// Releases the statement list together with the PolyEval trees it owns
+void Parser::clear_program()
+{
+    for (Statement& stmt : program) {
+        free_poly_eval(stmt.rhs_eval);
+    }
+    program.clear();
+}
+
+void PolyEvalDeleter::operator()(PolyEval* eval) const
+{
+    if (!eval) return;
+    for (PolyArgument& arg : eval->args) {
+        (*this)(arg.poly_eval);
+    }
+    delete eval;
+}
+
+void Parser::free_poly_eval(PolyEval* eval)
+{
+    PolyEvalDeleter()(eval);
 }
 
 // tasks_section → TASKS num_list
@@ -104,7 +409,50 @@ void Parser::parse_num_list()
 void Parser::parse_poly_section()
 {
     expect(POLY);
-    parse_poly_decl_list();
+    if (poly_cache) {
+        load_cached_polys(); // the declarations were not lexed
+    } else if (options.parallel_poly && options.threads > 1) {
+        parse_poly_decl_list_parallel();
+    } else {
+        parse_poly_decl_list();
+    }
+}
+
+// Declares the polynomials stored in the cache. Bodies stay in the mapped
+// file: Task 2 evaluates them in place and Tasks 3-5 rebuild them on demand
+void Parser::load_cached_polys()
+{
+    for (int i = 0; i < poly_cache->decl_count(); i++) {
+        const PolyCacheDecl& record = poly_cache->decl(i);
+        
+        RichPolyDecl poly;
+        poly.name = poly_cache->name(i);
+        poly.params = poly_cache->params(i);
+        poly.line_number = poly_cache_line + record.line_offset;
+        poly.has_explicit_params = record.has_explicit_params;
+        duplicate_lines[poly.name].push_back(poly.line_number);
+        declarations.add(std::move(poly));
+    }
+}
+
+void Parser::materialize_cached_bodies()
+{
+    for (int i = 0; i < declarations.size(); i++) {
+        FlatBody& body = declarations[i].body;
+        body.clear();
+        body.root = body.add_list(poly_cache->view(), poly_cache->decl(i).root_list);
+    }
+}
+
+// True if the POLY section has no semantic errors of its own
+bool Parser::poly_section_valid()
+{
+    for (auto& pair : duplicate_lines) {
+        if (pair.second.size() > 1) {
+            return false;
+        }
+    }
+    return im4_errors.empty();
 }
 
 // poly_decl_list → poly_decl
@@ -118,6 +466,123 @@ void Parser::parse_poly_decl_list()
     }
 }
 
+// Declarations below this count are parsed by parse_poly_decl_list() even
+// when parallel parsing is requested
+#define PARALLEL_POLY_MIN_DECLS 64
+
+// Same as parse_poly_decl_list(), on options.threads threads. A declaration
+// starts with an ID and ends with the first SEMICOLON after it, since there
+// is none inside a declaration, so the extents of all declarations can be
+// found by scanning the tokens, and each declaration parses the same on its
+// own as in sequence. The declarations are dealt out in contiguous groups
+// of about the same number of tokens, each parsed by a Parser of its own
+// that reads them from this parser's lexer, and the results are merged in
+// source order: the declarations, their DMT-12 lines and the IM-4 lines. A
+// syntax error in any group is one of the program, reported once, as the
+// serial parser would. If an extent cannot be found the serial parser runs
+// instead.
+void Parser::parse_poly_decl_list_parallel()
+{
+    auto start = chrono::steady_clock::now();
+    const std::vector<Token>& tokens = lexer.Tokens();
+    int first = lexer.Position();
+    int token_count = tokens.size();
+    
+    // poly_decl_list → poly_decl | poly_decl poly_decl_list
+    std::vector<int> ends;  // one past the SEMICOLON of each declaration
+    int position = first;
+    do {
+        while (position < token_count && tokens[position].token_type != SEMICOLON) {
+            position++;
+        }
+        if (position == token_count) {
+            break;
+        }
+        ends.push_back(++position);
+    } while (position < token_count && tokens[position].token_type == ID);
+    
+    if (position == token_count || (int)ends.size() < PARALLEL_POLY_MIN_DECLS) {
+        parse_poly_decl_list();
+        return;
+    }
+    
+    struct DeclGroup {
+        int begin = 0, end = 0;              // tokens
+        int decl_count = 0;
+        std::istringstream no_input;
+        std::ostringstream discarded;        // the syntax error message
+        std::unique_ptr<Parser> parser;
+        bool syntax_error = false;
+    };
+    int group_count = std::min<int>(options.threads, ends.size());
+    std::vector<DeclGroup> groups(group_count);
+    int decl_start = first;
+    for (int end : ends) {
+        int g = (int)((int64_t)(decl_start - first) * group_count / (ends.back() - first));
+        if (groups[g].decl_count == 0) {
+            groups[g].begin = decl_start;
+        }
+        groups[g].end = end;
+        groups[g].decl_count++;
+        decl_start = end;
+    }
+    
+    auto parse_group = [&](int g) {
+        DeclGroup& group = groups[g];
+        if (group.decl_count == 0) {
+            return;
+        }
+        group.parser.reset(new Parser(group.no_input, group.discarded));
+        Parser& parser = *group.parser;
+        parser.options = options;
+        parser.options.print_stats = false;
+        parser.clear_state();
+        parser.build_bodies = build_bodies;
+        parser.lexer = LexicalAnalyzer(lexer, group.begin, group.end);
+        try {
+            for (int i = 0; i < group.decl_count; i++) {
+                parser.parse_poly_decl();
+            }
+        } catch (const SyntaxError&) {
+            group.syntax_error = true;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int g = 1; g < group_count; g++) {
+        workers.emplace_back(parse_group, g);
+    }
+    parse_group(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    
+    for (DeclGroup& group : groups) {
+        if (group.syntax_error) {
+            syntax_error();
+        }
+    }
+    for (DeclGroup& group : groups) {
+        if (group.decl_count == 0) {
+            continue;
+        }
+        DeclStore& parsed = group.parser->declarations;
+        for (int i = 0; i < parsed.size(); i++) {
+            RichPolyDecl& poly = parsed[i];
+            duplicate_lines[poly.name].push_back(poly.line_number);
+            current_decl = declarations.add(std::move(poly));
+        }
+        const std::vector<int>& lines = group.parser->im4_errors;
+        im4_errors.insert(im4_errors.end(), lines.begin(), lines.end());
+    }
+    lexer.Seek(ends.back());
+    
+    if (options.print_stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "stats: parallel poly decls=" << ends.size() << " threads=" << group_count
+             << " ms=" << (long)ms << endl;
+    }
+}
+
 // poly_decl → poly_header EQUAL poly_body SEMICOLON
 void Parser::parse_poly_decl()
 {
@@ -134,7 +599,7 @@ void Parser::parse_poly_header()
     Token name_token = lexer.peek(1);
     parse_poly_name();
     
-    PolyDecl poly;
+    RichPolyDecl poly;
     poly.name = name_token.lexeme;
     poly.line_number = name_token.line_no;
     
@@ -149,20 +614,12 @@ void Parser::parse_poly_header()
         poly.params.push_back("x");
     }
     
+    poly.has_explicit_params = (t.token_type == LPAREN);  // was there an explicit param list?
+    
     // Check for duplicates
     duplicate_lines[poly.name].push_back(poly.line_number);
     
-    polynomials.push_back(poly);
-    current_poly = &polynomials.back(); // Set current poly for body parsing
-    
-    // Also create rich polynomial representation
-    RichPolyDecl rich_poly;
-    rich_poly.name = poly.name;
-    rich_poly.params = poly.params;
-    rich_poly.line_number = poly.line_number;
-    rich_poly.has_explicit_params = (t.token_type == LPAREN);  // was there an explicit param list?
-    rich_polynomials.push_back(rich_poly);
-    current_rich_poly = &rich_polynomials.back();
+    current_decl = declarations.add(std::move(poly)); // Set current declaration for body parsing
 }
 
 // id_list → ID
@@ -202,9 +659,8 @@ void Parser::parse_poly_name()
 // poly_body → term_list
 void Parser::parse_poly_body()
 {
-    if (current_rich_poly) {
-        current_rich_poly->body.clear();
-        parse_rich_term_list(current_rich_poly->body);
+    if (current_decl >= 0 && build_bodies) {
+        parse_rich_poly_body(declarations[current_decl].body);
     } else {
         parse_term_list(); // For semantic checking only
     }
@@ -216,9 +672,10 @@ void Parser::parse_term_list()
 {
     parse_term();
     Token t = lexer.peek(1);
-    if (t.token_type == PLUS || t.token_type == MINUS) {
+    while (t.token_type == PLUS || t.token_type == MINUS) {
         parse_add_operator();
-        parse_term_list();
+        parse_term();
+        t = lexer.peek(1);
     }
 }
 
@@ -263,7 +720,7 @@ void Parser::parse_monomial()
     Token id_token = expect(ID);
     
     // Check if this monomial name is valid (IM-4 check)
-    if (current_poly && !is_valid_monomial(id_token.lexeme)) {
+    if (current_decl >= 0 && !is_valid_monomial(id_token.lexeme)) {
         im4_errors.push_back(id_token.line_no);
     }
     
@@ -324,11 +781,12 @@ void Parser::parse_execute_section()
 // statement_list → statement statement_list
 void Parser::parse_statement_list()
 {
-    parse_statement();
-    Token t = lexer.peek(1);
-    if (t.token_type == INPUT || t.token_type == OUTPUT || t.token_type == ID) {
-        parse_statement_list();
-    }
+    // A loop rather than recursion: long programs would overflow the stack
+    TokenType next;
+    do {
+        parse_statement();
+        next = lexer.peek(1).token_type;
+    } while (next == INPUT || next == OUTPUT || next == ID);
 }
 
 // statement → input_statement
@@ -351,28 +809,36 @@ void Parser::parse_statement()
 // input_statement → INPUT ID SEMICOLON
 void Parser::parse_input_statement()
 {
-    expect(INPUT);
+    Token input_token = expect(INPUT);
     Token id_token = expect(ID);
     expect(SEMICOLON);
+    if (!build_program) {
+        return;
+    }
     
     // Create statement for Task 2
     Statement stmt;
     stmt.type = STMT_INPUT;
     stmt.var_index = get_or_create_variable(id_token.lexeme);
+    stmt.line_number = input_token.line_no;
     program.push_back(stmt);
 }
 
 // output_statement → OUTPUT ID SEMICOLON
 void Parser::parse_output_statement()
 {
-    expect(OUTPUT);
+    Token output_token = expect(OUTPUT);
     Token id_token = expect(ID);
     expect(SEMICOLON);
+    if (!build_program) {
+        return;
+    }
     
     // Create statement for Task 2
     Statement stmt;
     stmt.type = STMT_OUTPUT;
     stmt.var_index = get_or_create_variable(id_token.lexeme);
+    stmt.line_number = output_token.line_no;
     program.push_back(stmt);
 }
 
@@ -381,17 +847,23 @@ void Parser::parse_assign_statement()
 {
     Token id_token = expect(ID);
     expect(EQUAL);
+    if (!build_program) {
+        parse_poly_evaluation(); // For semantic checking only
+        expect(SEMICOLON);
+        return;
+    }
     
     // Parse polynomial evaluation and build representation
-    PolyEval* poly_eval = parse_poly_evaluation_return();
+    PolyEvalPtr poly_eval(parse_poly_evaluation_return());
     expect(SEMICOLON);
     
     // Create statement for Task 2
     Statement stmt;
     stmt.type = STMT_ASSIGN;
     stmt.lhs_index = get_or_create_variable(id_token.lexeme);
-    stmt.rhs_eval = poly_eval;
+    stmt.line_number = id_token.line_no;
     program.push_back(stmt);
+    program.back().rhs_eval = poly_eval.release();
 }
 
 // poly_evaluation → poly_name LPAREN argument_list RPAREN
@@ -407,12 +879,12 @@ void Parser::parse_poly_evaluation()
     expect(RPAREN);
     
     // Check AUP-13: undeclared polynomial
-    PolyDecl* poly = find_polynomial(name_token.lexeme);
-    if (!poly) {
+    int handle = declarations.find(name_token.lexeme);
+    if (handle < 0) {
         aup13_errors.push_back(name_token.line_no);
     } else {
         // Check NA-7: wrong number of arguments
-        if (arg_count != (int)poly->params.size()) {
+        if (arg_count != (int)declarations[handle].params.size()) {
             na7_errors.push_back(name_token.line_no);
         }
     }
@@ -467,7 +939,13 @@ void Parser::parse_argument()
 void Parser::parse_inputs_section()
 {
     expect(INPUTS);
-    parse_inputs_num_list();
+    if (build_inputs) {
+        parse_inputs_num_list();
+    } else {
+        do {
+            expect(NUM);
+        } while (lexer.peek(1).token_type == NUM);
+    }
 }
 
 // Semantic checking functions
@@ -488,6 +966,23 @@ void Parser::check_semantic_errors()
 }
 
 void Parser::output_semantic_errors()
+{
+    std::string code;
+    std::vector<int> lines;
+    if (!first_semantic_error(code, lines)) {
+        return;
+    }
+    
+    *out << "Semantic Error Code " << code << ":";
+    for (int line : lines) {
+        *out << " " << line;
+    }
+    *out << endl;
+}
+
+// Only the first kind of semantic error is reported, in this order:
+// DMT-12, IM-4, AUP-13, NA-7. Line numbers are returned sorted.
+bool Parser::first_semantic_error(std::string& code, std::vector<int>& lines)
 {
     // DMT-12: Duplicate polynomial declarations
     std::vector<int> all_duplicate_lines;
@@ -499,55 +994,32 @@ void Parser::output_semantic_errors()
             }
         }
     }
-    if (!all_duplicate_lines.empty()) {
-        cout << "Semantic Error Code DMT-12:";
-        sort(all_duplicate_lines.begin(), all_duplicate_lines.end());
-        for (int line : all_duplicate_lines) {
-            cout << " " << line;
-        }
-        cout << endl;
-        exit(1);
-    }
-    
-    // IM-4: Invalid monomial name
-    if (!im4_errors.empty()) {
-        cout << "Semantic Error Code IM-4:";
-        sort(im4_errors.begin(), im4_errors.end());
-        for (int line : im4_errors) {
-            cout << " " << line;
-        }
-        cout << endl;
-        exit(1);
-    }
     
-    // AUP-13: Attempted use of undeclared polynomial
-    if (!aup13_errors.empty()) {
-        cout << "Semantic Error Code AUP-13:";
-        sort(aup13_errors.begin(), aup13_errors.end());
-        for (int line : aup13_errors) {
-            cout << " " << line;
-        }
-        cout << endl;
-        exit(1);
+    if (!all_duplicate_lines.empty()) {
+        code = "DMT-12";
+        lines = all_duplicate_lines;
+    } else if (!im4_errors.empty()) {
+        code = "IM-4";           // Invalid monomial name
+        lines = im4_errors;
+    } else if (!aup13_errors.empty()) {
+        code = "AUP-13";         // Attempted use of undeclared polynomial
+        lines = aup13_errors;
+    } else if (!na7_errors.empty()) {
+        code = "NA-7";           // Wrong number of arguments
+        lines = na7_errors;
+    } else {
+        return false;
     }
     
-    // NA-7: Wrong number of arguments
-    if (!na7_errors.empty()) {
-        cout << "Semantic Error Code NA-7:";
-        sort(na7_errors.begin(), na7_errors.end());
-        for (int line : na7_errors) {
-            cout << " " << line;
-        }
-        cout << endl;
-        exit(1);
-    }
+    sort(lines.begin(), lines.end());
+    return true;
 }
 
 bool Parser::is_valid_monomial(const std::string& name)
 {
-    if (!current_poly) return true;
+    if (current_decl < 0) return true;
     
-    for (const std::string& param : current_poly->params) {
+    for (const std::string& param : declarations[current_decl].params) {
         if (param == name) {
             return true;
         }
@@ -555,28 +1027,30 @@ bool Parser::is_valid_monomial(const std::string& name)
     return false;
 }
 
-PolyDecl* Parser::find_polynomial(const std::string& name)
-{
-    for (PolyDecl& poly : polynomials) {
-        if (poly.name == name) {
-            return &poly;
-        }
-    }
-    return nullptr;
-}
-
 // Task execution functions
 void Parser::execute_tasks()
 {
+    if (options.print_stats) {
+        print_body_stats();
+    }
+    
     // Execute tasks in order: 2, 3, 4, 5 (Task 1 is always executed)
     if (requested_tasks.count(2)) {
         execute_task_2();
     }
     
+    if (poly_cache && (requested_tasks.count(3) || requested_tasks.count(4) || requested_tasks.count(5))) {
+        materialize_cached_bodies();
+    }
+    
     if (requested_tasks.count(3)) {
         execute_task_3();
     }
     
+    // Tasks 4 and 5 share the forms computed for each declaration
+    decl_forms.assign(declarations.size(), DeclForms());
+    forms_reused = 0;
+    
     if (requested_tasks.count(4)) {
         execute_task_4();
     }
@@ -584,26 +1058,96 @@ void Parser::execute_tasks()
     if (requested_tasks.count(5)) {
         execute_task_5();
     }
+    
+    if (options.print_stats && (requested_tasks.count(4) || requested_tasks.count(5))) {
+        cerr << "stats: forms decls=" << declarations.size()
+             << " task5-from-combined=" << forms_reused << endl;
+    }
+    decl_forms.clear();
+}
+
+// TermNode form of a declaration's body. Task 3 prints the body as parsed,
+// since the parser already aligns powers to the parameter list, so this is
+// also its normalized form.
+const std::vector<TermNode>& Parser::normalized_terms(int handle)
+{
+    DeclForms& forms = decl_forms[handle];
+    if (!forms.has_terms) {
+        const FlatBody& body = declarations[handle].body;
+        forms.terms = flat_to_terms(body.view(), body.root);
+        forms.has_terms = true;
+    }
+    return forms.terms;
+}
+
+// Task 4 form, built from the normalized form, which is released since
+// Task 5 continues from this one
+const std::vector<TermNode>& Parser::combined_terms(int handle)
+{
+    DeclForms& forms = decl_forms[handle];
+    if (!forms.has_combined) {
+        forms.combined = combine_identical_monomials(normalized_terms(handle), declarations[handle].params);
+        forms.has_combined = true;
+        std::vector<TermNode>().swap(forms.terms);
+        forms.has_terms = false;
+    }
+    return forms.combined;
+}
+
+// What Task 5 expands: Task 4's result if it was computed, as combining
+// does not change the polynomial (coefficients are summed in the same
+// wrapping int arithmetic) and leaves fewer terms to multiply, otherwise
+// the normalized form
+const std::vector<TermNode>& Parser::expansion_terms(int handle)
+{
+    if (decl_forms[handle].has_combined) {
+        forms_reused++;
+        return decl_forms[handle].combined;
+    }
+    return normalized_terms(handle);
+}
+
+// Size of the flat bodies against what the same terms take as TermNode
+// trees (node, exponent vector and one vector per parenthesized factor)
+void Parser::print_body_stats()
+{
+    uint64_t terms = 0, flat_bytes = 0, tree_bytes = 0;
+    for (int i = 0; i < declarations.size(); i++) {
+        const FlatBody& body = declarations[i].body;
+        terms += body.terms.size();
+        flat_bytes += body.bytes();
+        tree_bytes += body.terms.size() * sizeof(TermNode) + body.exps.size() * sizeof(int);
+        if (!body.lists.empty()) {
+            tree_bytes += (body.lists.size() - 1) * sizeof(std::vector<TermNode>);
+        }
+    }
+    cerr << "stats: bodies decls=" << declarations.size() << " terms=" << terms
+         << " flat-bytes=" << flat_bytes << " tree-bytes~" << tree_bytes;
+    if (terms > 0) {
+        cerr << " flat-bytes/term=" << flat_bytes / terms << " tree-bytes/term~" << tree_bytes / terms;
+    }
+    cerr << endl;
 }
 
 void Parser::execute_task_3()
 {
     // For now, just output placeholder
-    if (!rich_polynomials.empty()) {
-        cout << "POLY - SORTED MONOMIAL LISTS" << endl;
-        for (const auto& poly : rich_polynomials) {
-            cout << "\t" << format_poly_decl(poly) << ";" << endl;
+    if (!declarations.empty()) {
+        *out << "POLY - SORTED MONOMIAL LISTS" << endl;
+        for (int i = 0; i < declarations.size(); i++) {
+            const RichPolyDecl& poly = declarations[i];
+            *out << "\t" << format_poly_decl(poly) << ";" << endl;
         }
     }
 }
 
 // Helper functions for Task 3 - temporary implementations
-std::string Parser::format_monomial_list(const std::vector<int>& powers, const std::vector<std::string>& params)
+std::string Parser::format_monomial_list(const int* powers, size_t count, const std::vector<std::string>& params)
 {
     std::string result;
     bool first = true;
     
-    for (int i = 0; i < (int)powers.size() && i < (int)params.size(); i++) {
+    for (int i = 0; i < (int)count && i < (int)params.size(); i++) {
         if (powers[i] > 0) {
             if (!first) result += " ";
             first = false;
@@ -645,7 +1189,7 @@ std::string Parser::format_term(const TermNode& term, const std::vector<std::str
         }
         
         if (!all_zero) {
-            result += format_monomial_list(term.monomial_list, params);
+            result += format_monomial_list(term.monomial_list.data(), term.monomial_list.size(), params);
         }
     } else {
         // PARENLIST - format parenthesized lists
@@ -655,38 +1199,107 @@ std::string Parser::format_term(const TermNode& term, const std::vector<std::str
     return result;
 }
 
-std::string Parser::format_poly_decl(const RichPolyDecl& poly)
+// Same output as format_term() on the TermNode form of the term
+std::string Parser::format_flat_term(const FlatView& view, const FlatTerm& term, const std::vector<std::string>& params, bool is_first)
 {
-    std::string result = poly.name;
+    std::string result;
     
-    // Show parameters if: 
-    // 1. More than one parameter, OR
-    // 2. Explicitly specified parameter list (even if it's just "x")
-    if (poly.params.size() > 1 || poly.has_explicit_params) {
-        result += "(";
-        for (int i = 0; i < (int)poly.params.size(); i++) {
-            if (i > 0) result += ",";
-            result += poly.params[i];
-        }
-        result += ")";
+    if (!is_first) {
+        result += (term.op == OP_PLUS) ? " + " : " - ";
+    } else if (term.op == OP_MINUS) {
+        result += "- ";
     }
     
-    result += " = ";
-    
-    // Format terms
-    if (!poly.body.empty()) {
-        result += format_term(poly.body[0], poly.params, true);
-        for (int i = 1; i < (int)poly.body.size(); i++) {
-            result += format_term(poly.body[i], poly.params, false);
+    if (term.kind == MLIST) {
+        const int* powers = view.exps + term.first;
+        bool all_zero = true;
+        for (uint32_t i = 0; i < term.count; i++) {
+            if (powers[i] != 0) {
+                all_zero = false;
+                break;
+            }
+        }
+        
+        if (term.coefficient != 1 || all_zero) {
+            result += std::to_string(abs(term.coefficient));
+            if (!all_zero) result += " ";
+        }
+        
+        if (!all_zero) {
+            result += format_monomial_list(powers, term.count, params);
         }
     } else {
-        result += "0"; // Empty polynomial
+        for (uint32_t i = 0; i < term.count; i++) {
+            result += "(" + format_flat_list(view, term.first + i, params) + ")";
+        }
     }
     
     return result;
 }
 
-std::string Parser::format_parenthesized_list(const std::vector<std::vector<TermNode>>& paren_list, const std::vector<std::string>& params)
+std::string Parser::format_flat_list(const FlatView& view, uint32_t list, const std::vector<std::string>& params)
+{
+    std::string result;
+    const FlatList& range = view.lists[list];
+    for (uint32_t i = 0; i < range.term_count; i++) {
+        result += format_flat_term(view, view.terms[range.first_term + i], params, i == 0);
+    }
+    return result;
+}
+
+std::string Parser::format_poly_decl(const RichPolyDecl& poly)
+{
+    std::string result = format_poly_header(poly);
+    
+    if (!poly.body.empty()) {
+        result += format_flat_list(poly.body.view(), poly.body.root, poly.params);
+    } else {
+        result += "0"; // Empty polynomial
+    }
+    
+    return result;
+}
+
+// Declaration with a body computed by Task 4 or 5
+std::string Parser::format_poly_terms(const RichPolyDecl& poly, const std::vector<TermNode>& body)
+{
+    std::string result = format_poly_header(poly);
+    
+    // Format terms
+    if (!body.empty()) {
+        result += format_term(body[0], poly.params, true);
+        for (int i = 1; i < (int)body.size(); i++) {
+            result += format_term(body[i], poly.params, false);
+        }
+    } else {
+        result += "0"; // Empty polynomial
+    }
+    
+    return result;
+}
+
+// Name, optional parameter list and " = "
+std::string Parser::format_poly_header(const RichPolyDecl& poly)
+{
+    std::string result = poly.name;
+    
+    // Show parameters if: 
+    // 1. More than one parameter, OR
+    // 2. Explicitly specified parameter list (even if it's just "x")
+    if (poly.params.size() > 1 || poly.has_explicit_params) {
+        result += "(";
+        for (int i = 0; i < (int)poly.params.size(); i++) {
+            if (i > 0) result += ",";
+            result += poly.params[i];
+        }
+        result += ")";
+    }
+    
+    result += " = ";
+    return result;
+}
+
+std::string Parser::format_parenthesized_list(const std::vector<std::vector<TermNode>>& paren_list, const std::vector<std::string>& params)
 {
     std::string result;
     
@@ -709,38 +1322,48 @@ std::string Parser::format_parenthesized_list(const std::vector<std::vector<Term
 }
 
 // Rich parsing functions - actual implementations
-void Parser::parse_rich_poly_body(std::vector<TermNode>& terms)
+
+// The body is built directly in flat form; nested factor lists are
+// appended to the pools before the lists that contain them
+void Parser::parse_rich_poly_body(FlatBody& body)
 {
-    parse_rich_term_list(terms);
+    body.clear();
+    FlatList root = parse_rich_term_list(body);
+    body.root = body.lists.size();
+    body.lists.push_back(root);
 }
 
-void Parser::parse_rich_term_list(std::vector<TermNode>& terms)
+// The records of one list are collected locally and appended at the end so
+// that they stay contiguous even though nested factors are added first
+FlatList Parser::parse_rich_term_list(FlatBody& body)
 {
     // term_list → term
     // term_list → term add_operator term_list
     
-    TermNode term;
-    term.op = OP_PLUS; // First term is always positive
-    parse_rich_term(term);
-    terms.push_back(term);
-    
-    Token t = lexer.peek(1);
-    if (t.token_type == PLUS || t.token_type == MINUS) {
-        parse_add_operator(); // Consume the operator
+    std::vector<FlatTerm> terms;
+    OpType op = OP_PLUS; // First term is always positive
+    while (true) {
+        FlatTerm term;
+        parse_rich_term(body, term);
+        term.op = op;
+        terms.push_back(term);
         
-        // Set up the next term with the operator
-        std::vector<TermNode> rest_terms;
-        parse_rich_term_list(rest_terms);
-        
-        // Set the operator for the first term in rest_terms
-        if (!rest_terms.empty()) {
-            rest_terms[0].op = (t.token_type == PLUS) ? OP_PLUS : OP_MINUS;
-            terms.insert(terms.end(), rest_terms.begin(), rest_terms.end());
+        Token t = lexer.peek(1);
+        if (t.token_type != PLUS && t.token_type != MINUS) {
+            break;
         }
+        parse_add_operator(); // Consume the operator
+        op = (t.token_type == PLUS) ? OP_PLUS : OP_MINUS;
     }
+    
+    FlatList list;
+    list.first_term = body.terms.size();
+    list.term_count = terms.size();
+    body.terms.insert(body.terms.end(), terms.begin(), terms.end());
+    return list;
 }
 
-void Parser::parse_rich_term(TermNode& term)
+void Parser::parse_rich_term(FlatBody& body, FlatTerm& term)
 {
     // term → monomial_list
     // term → coefficient monomial_list  
@@ -748,26 +1371,36 @@ void Parser::parse_rich_term(TermNode& term)
     // term → parenthesized_list
     
     term.kind = MLIST;
+    term.op = OP_PLUS;
+    term.reserved = 0;
     term.coefficient = 1;
-    term.monomial_list.clear();
-    term.monomial_list.resize(current_rich_poly->params.size(), 0);
     
     Token t1 = lexer.peek(1);
-    if (t1.token_type == ID) {
-        // monomial_list
-        parse_rich_monomial_list(term.monomial_list);
-    } else if (t1.token_type == NUM) {
-        // coefficient [monomial_list]
-        term.coefficient = parse_rich_coefficient();
-        Token t2 = lexer.peek(1);
-        if (t2.token_type == ID) {
-            parse_rich_monomial_list(term.monomial_list);
+    if (t1.token_type == ID || t1.token_type == NUM) {
+        std::vector<int> powers(declarations[current_decl].params.size(), 0);
+        if (t1.token_type == ID) {
+            // monomial_list
+            parse_rich_monomial_list(powers);
+        } else {
+            // coefficient [monomial_list]
+            term.coefficient = parse_rich_coefficient();
+            Token t2 = lexer.peek(1);
+            if (t2.token_type == ID) {
+                parse_rich_monomial_list(powers);
+            }
+            // else just coefficient case (powers stay all zeros)
         }
-        // else just coefficient case (monomial_list stays all zeros)
+        term.first = body.exps.size();
+        term.count = powers.size();
+        body.exps.insert(body.exps.end(), powers.begin(), powers.end());
     } else if (t1.token_type == LPAREN) {
         // parenthesized_list
         term.kind = PARENLIST;
-        parse_rich_parenthesized_list(term.parenthesized_list);
+        std::vector<FlatList> factors;
+        parse_rich_parenthesized_list(body, factors);
+        term.first = body.lists.size();
+        term.count = factors.size();
+        body.lists.insert(body.lists.end(), factors.begin(), factors.end());
     } else {
         syntax_error();
     }
@@ -782,15 +1415,16 @@ void Parser::parse_rich_monomial_list(std::vector<int>& powers)
     Token id_token = expect(ID);
     
     // Check if this monomial name is valid (IM-4 check)
-    if (current_poly && !is_valid_monomial(id_token.lexeme)) {
+    if (current_decl >= 0 && !is_valid_monomial(id_token.lexeme)) {
         im4_errors.push_back(id_token.line_no);
     }
     
     // Find the parameter index
     std::string var_name = id_token.lexeme;
     int param_index = -1;
-    for (int i = 0; i < (int)current_rich_poly->params.size(); i++) {
-        if (current_rich_poly->params[i] == var_name) {
+    const std::vector<std::string>& params = declarations[current_decl].params;
+    for (int i = 0; i < (int)params.size(); i++) {
+        if (params[i] == var_name) {
             param_index = i;
             break;
         }
@@ -823,35 +1457,31 @@ int Parser::parse_rich_coefficient()
     return std::stoi(t.lexeme);
 }
 
-void Parser::parse_rich_parenthesized_list(std::vector<std::vector<TermNode>>& paren_list)
+void Parser::parse_rich_parenthesized_list(FlatBody& body, std::vector<FlatList>& factors)
 {
     // parenthesized_list → LPAREN term_list RPAREN
     // parenthesized_list → LPAREN term_list RPAREN parenthesized_list
     
     expect(LPAREN);
-    std::vector<TermNode> term_list;
-    parse_rich_term_list(term_list);
+    FlatList term_list = parse_rich_term_list(body);
     expect(RPAREN);
     
-    paren_list.push_back(term_list);
+    factors.push_back(term_list);
     
     Token t = lexer.peek(1);
     if (t.token_type == LPAREN) {
-        parse_rich_parenthesized_list(paren_list);
+        parse_rich_parenthesized_list(body, factors);
     }
 }
 
 // Task 2 implementation functions
 void Parser::parse_inputs_num_list()
 {
-    Token num_token = expect(NUM);
-    int value = std::stoi(num_token.lexeme);
-    inputs.push_back(value);
-    
-    Token t = lexer.peek(1);
-    if (t.token_type == NUM) {
-        parse_inputs_num_list();
-    }
+    // A loop rather than recursion: the section can have millions of values
+    do {
+        Token num_token = expect(NUM);
+        inputs.push_back(std::stoi(num_token.lexeme));
+    } while (lexer.peek(1).token_type == NUM);
 }
 
 int Parser::get_or_create_variable(const std::string& name)
@@ -869,15 +1499,15 @@ PolyEval* Parser::parse_poly_evaluation_return()
     parse_poly_name();
     expect(LPAREN);
     
-    // Create evaluation structure
-    PolyEval* eval = new PolyEval();
+    // Create evaluation structure; freed if a syntax error is thrown before
+    // it is returned
+    PolyEvalPtr eval(new PolyEval());
     
     // Find polynomial index
-    for (int i = 0; i < (int)rich_polynomials.size(); i++) {
-        if (rich_polynomials[i].name == name_token.lexeme) {
-            eval->poly_index = i;
-            break;
-        }
+    if (resident_polys) {
+        eval->poly_index = resident_polys->find(name_token.lexeme);
+    } else {
+        eval->poly_index = declarations.find(name_token.lexeme);
     }
     
     // Parse arguments
@@ -886,16 +1516,21 @@ PolyEval* Parser::parse_poly_evaluation_return()
     expect(RPAREN);
     
     // Still do semantic checks
-    PolyDecl* poly = find_polynomial(name_token.lexeme);
-    if (!poly) {
-        aup13_errors.push_back(name_token.line_no);
-    } else {
-        if ((int)eval->args.size() != (int)poly->params.size()) {
-            na7_errors.push_back(name_token.line_no);
+    int param_count = -1;
+    if (resident_polys) {
+        if (eval->poly_index >= 0) {
+            param_count = (int)resident_polys->decl(eval->poly_index).params.size();
         }
+    } else if (eval->poly_index >= 0) {
+        param_count = (int)declarations[eval->poly_index].params.size();
+    }
+    if (param_count < 0) {
+        aup13_errors.push_back(name_token.line_no);
+    } else if ((int)eval->args.size() != param_count) {
+        na7_errors.push_back(name_token.line_no);
     }
     
-    return eval;
+    return eval.release();
 }
 
 void Parser::parse_argument_list_return(std::vector<PolyArgument>& args)
@@ -941,12 +1576,39 @@ PolyArgument Parser::parse_argument_return()
 
 void Parser::execute_task_2()
 {
+    std::vector<bool> dead;
+    if (options.skip_dead_assignments) {
+        dead = find_dead_assignments();
+    }
+    eval_state = prepare_eval_state();
+    jit = eval_state->jit.get();
+    std::unique_ptr<Profiler> profile;
+    if (options.profile) {
+        int poly_count = resident_polys ? resident_polys->size() : declarations.size();
+        profile.reset(new Profiler(poly_count, program.size()));
+        profiler = profile.get();
+    }
+    if (options.parallel_execute && options.threads > 1 && !input_reader && !profiler) {
+        execute_task_2_parallel(dead);
+        finish_task_2();
+        return;
+    }
+    
     // Execute the program by going through the statement list
-    for (const Statement& stmt : program) {
+    for (int i = 0; i < (int)program.size(); i++) {
+        const Statement& stmt = program[i];
+        if (profiler) {
+            profiler->start_statement();
+        }
         switch (stmt.type) {
             case STMT_INPUT:
                 if (stmt.var_index >= 0 && stmt.var_index < (int)memory.size()) {
-                    if (next_input < (int)inputs.size()) {
+                    if (input_reader) {
+                        int value;
+                        if (input_reader->next(value)) {
+                            memory[stmt.var_index] = value;
+                        }
+                    } else if (next_input < (int)inputs.size()) {
                         memory[stmt.var_index] = inputs[next_input];
                     }
                     // Always increment next_input, even if no more inputs available
@@ -956,28 +1618,393 @@ void Parser::execute_task_2()
                 
             case STMT_OUTPUT:
                 if (stmt.var_index >= 0 && stmt.var_index < (int)memory.size()) {
-                    std::cout << memory[stmt.var_index] << std::endl;
+                    *out << memory[stmt.var_index] << endl;
                 } else {
-                    std::cout << 0 << std::endl; // Default for invalid index
+                    *out << 0 << endl; // Default for invalid index
                 }
                 break;
                 
             case STMT_ASSIGN:
+                if (!dead.empty() && dead[i]) {
+                    break;
+                }
                 if (stmt.lhs_index >= 0 && stmt.lhs_index < (int)memory.size()) {
                     memory[stmt.lhs_index] = evaluate_polynomial(stmt.rhs_eval);
                 }
                 break;
         }
+        if (profiler) {
+            profiler->end_statement(i);
+        }
+    }
+    finish_task_2();
+}
+
+// Marks every declaration the evaluation calls, nested calls included
+static void collect_called(const PolyEval* eval, std::vector<bool>& called)
+{
+    if (!eval) return;
+    if (eval->poly_index >= 0 && eval->poly_index < (int)called.size()) {
+        called[eval->poly_index] = true;
+    }
+    for (const PolyArgument& arg : eval->args) {
+        if (arg.kind == ARG_POLYEVAL) {
+            collect_called(arg.poly_eval, called);
+        }
+    }
+}
+
+// The EvalState of the declarations Task 2 runs against. Resident
+// declarations (CompiledPolys) bring their own, built when they were
+// compiled. For the parser's own declarations it is built by the first
+// Task 2 and kept until they are cleared; it plans only the declarations
+// that program calls.
+const EvalState* Parser::prepare_eval_state()
+{
+    if (resident_polys) {
+        return &resident_polys->eval_state();
+    }
+    if (own_eval_state) {
+        return own_eval_state.get();
+    }
+    
+    own_eval_state.reset(new EvalState());
+    int poly_count = declarations.size();
+    if (options.cse_plans) {
+        std::vector<bool> called(poly_count, false);
+        for (const Statement& stmt : program) {
+            if (stmt.type == STMT_ASSIGN) {
+                collect_called(stmt.rhs_eval, called);
+            }
+        }
+        for (int handle = 0; handle < poly_count; handle++) {
+            if (called[handle]) {
+                const RichPolyDecl& poly = declarations[handle];
+                FlatView view = poly_cache ? poly_cache->view() : poly.body.view();
+                uint32_t root = poly_cache ? poly_cache->decl(handle).root_list : poly.body.root;
+                own_eval_state->add_plan(handle, view, root, poly.params.size());
+            }
+        }
+        if (options.print_stats) {
+            cerr << "stats: cse planned=" << own_eval_state->planned << " used=" << own_eval_state->used
+                 << " multiplications=" << own_eval_state->multiplications
+                 << " naive-multiplications=" << own_eval_state->naive_multiplications << endl;
+        }
+    }
+    if (options.jit_threshold > 0 && jit_supported()) {
+        own_eval_state->jit.reset(new PolyJit(poly_count, options.jit_threshold));
+    }
+    return own_eval_state.get();
+}
+
+void Parser::finish_task_2()
+{
+    eval_state = nullptr;
+    if (profiler) {
+        report_profile();
+        profiler = nullptr;
+    }
+    if (!jit) {
+        return;
+    }
+    if (options.print_stats) {
+        cerr << "stats: jit threshold=" << options.jit_threshold << " compiled=" << jit->compiled()
+             << " code-bytes=" << jit->code_bytes() << endl;
+    }
+    jit = nullptr;
+}
+
+// Appends every variable the evaluation reads (valid memory locations only)
+static void collect_reads(const PolyEval* eval, int memory_size, std::vector<int>& reads)
+{
+    if (!eval) return;
+    for (const PolyArgument& arg : eval->args) {
+        if (arg.kind == ARG_ID && arg.var_index >= 0 && arg.var_index < memory_size) {
+            reads.push_back(arg.var_index);
+        } else if (arg.kind == ARG_POLYEVAL) {
+            collect_reads(arg.poly_eval, memory_size, reads);
+        }
+    }
+}
+
+// Number of polynomial calls made by the evaluation, nested ones included
+static uint64_t count_calls(const PolyEval* eval)
+{
+    if (!eval) return 0;
+    uint64_t calls = 1;
+    for (const PolyArgument& arg : eval->args) {
+        if (arg.kind == ARG_POLYEVAL) {
+            calls += count_calls(arg.poly_eval);
+        }
+    }
+    return calls;
+}
+
+// Backward liveness pass over the program. An assignment is dead if no
+// OUTPUT reads its variable before the variable is assigned or input again.
+// Evaluating a polynomial has no side effects, so dead assignments are not
+// evaluated at all. INPUT statements are always executed, since each one
+// consumes the next input whether its variable is live or not, but only
+// those that still find an input overwrite their variable. When the inputs
+// are streamed their number is not known and no INPUT ends a liveness.
+std::vector<bool> Parser::find_dead_assignments()
+{
+    std::vector<bool> dead(program.size(), false);
+    std::vector<bool> live(memory.size(), false);
+    std::vector<int> reads;
+    uint64_t dead_count = 0, skipped_calls = 0;
+    
+    int input_number = next_input;  // inputs consumed by the whole program
+    for (const Statement& stmt : program) {
+        if (stmt.type == STMT_INPUT && stmt.var_index >= 0 && stmt.var_index < (int)live.size()) {
+            input_number++;
+        }
+    }
+    
+    for (int i = (int)program.size() - 1; i >= 0; i--) {
+        const Statement& stmt = program[i];
+        switch (stmt.type) {
+            case STMT_INPUT:
+                if (stmt.var_index >= 0 && stmt.var_index < (int)live.size()) {
+                    input_number--;
+                    if (input_number < (int)inputs.size()) {
+                        live[stmt.var_index] = false;
+                    }
+                }
+                break;
+                
+            case STMT_OUTPUT:
+                if (stmt.var_index >= 0 && stmt.var_index < (int)live.size()) {
+                    live[stmt.var_index] = true;
+                }
+                break;
+                
+            case STMT_ASSIGN:
+                if (stmt.lhs_index < 0 || stmt.lhs_index >= (int)live.size()) {
+                    break;
+                }
+                if (!live[stmt.lhs_index]) {
+                    dead[i] = true;
+                    dead_count++;
+                    skipped_calls += count_calls(stmt.rhs_eval);
+                    break;
+                }
+                live[stmt.lhs_index] = false;  // the value before is not used here...
+                reads.clear();                 // ...unless the right-hand side reads it
+                collect_reads(stmt.rhs_eval, live.size(), reads);
+                for (int var : reads) {
+                    live[var] = true;
+                }
+                break;
+        }
+    }
+    
+    if (options.print_stats) {
+        cerr << "stats: liveness statements=" << program.size()
+             << " dead-assignments=" << dead_count
+             << " skipped-calls=" << skipped_calls << endl;
+    }
+    return dead;
+}
+
+// Task 2 on options.threads threads. Every statement is a node of a graph
+// whose edges order the accesses to each variable: a read after the write
+// it reads, a write after the reads and the write before it. Which input
+// each INPUT consumes is known before running, and OUTPUT values are
+// collected by position and printed at the end, so inputs and outputs need
+// no ordering beyond that of their variables and the output is the same as
+// that of the sequential loop.
+void Parser::execute_task_2_parallel(const std::vector<bool>& dead)
+{
+    auto start = chrono::steady_clock::now();
+    TaskGraph graph;
+    std::vector<int> node_statement;  // statement run by each node
+    std::vector<int> node_slot;       // INPUT: index in inputs, OUTPUT: index in values
+    std::vector<int> last_writer(memory.size(), -1);
+    std::vector<std::vector<int>> readers(memory.size());  // since the last write
+    std::vector<int> reads;
+    int output_count = 0;
+    
+    auto add_node = [&](int statement, int slot) {
+        node_statement.push_back(statement);
+        node_slot.push_back(slot);
+        return graph.add_node();
+    };
+    auto read = [&](int var, int node) {
+        if (last_writer[var] >= 0) {
+            graph.add_edge(last_writer[var], node);
+        }
+        readers[var].push_back(node);
+    };
+    auto write = [&](int var, int node) {
+        if (last_writer[var] >= 0 && last_writer[var] != node) {
+            graph.add_edge(last_writer[var], node);
+        }
+        for (int reader : readers[var]) {
+            if (reader != node) {
+                graph.add_edge(reader, node);
+            }
+        }
+        readers[var].clear();
+        last_writer[var] = node;
+    };
+    
+    for (int i = 0; i < (int)program.size(); i++) {
+        const Statement& stmt = program[i];
+        switch (stmt.type) {
+            case STMT_INPUT:
+                if (stmt.var_index >= 0 && stmt.var_index < (int)memory.size()) {
+                    if (next_input < (int)inputs.size()) {
+                        write(stmt.var_index, add_node(i, next_input));
+                    }
+                    next_input++;
+                }
+                break;
+                
+            case STMT_OUTPUT: {
+                int node = add_node(i, output_count++);
+                if (stmt.var_index >= 0 && stmt.var_index < (int)memory.size()) {
+                    read(stmt.var_index, node);
+                }
+                break;
+            }
+                
+            case STMT_ASSIGN: {
+                if ((!dead.empty() && dead[i]) || stmt.lhs_index < 0 || stmt.lhs_index >= (int)memory.size()) {
+                    break;
+                }
+                int node = add_node(i, -1);
+                reads.clear();
+                collect_reads(stmt.rhs_eval, memory.size(), reads);
+                for (int var : reads) {
+                    read(var, node);
+                }
+                write(stmt.lhs_index, node);
+                break;
+            }
+        }
+    }
+    
+    std::vector<int> values(output_count, 0);
+    WorkStealingPool pool(options.threads);
+    pool.run(graph, [&](int node) {
+        const Statement& stmt = program[node_statement[node]];
+        switch (stmt.type) {
+            case STMT_INPUT:
+                memory[stmt.var_index] = inputs[node_slot[node]];
+                break;
+            case STMT_OUTPUT:
+                if (stmt.var_index >= 0 && stmt.var_index < (int)memory.size()) {
+                    values[node_slot[node]] = memory[stmt.var_index];
+                }
+                break;
+            case STMT_ASSIGN:
+                memory[stmt.lhs_index] = evaluate_polynomial(stmt.rhs_eval);
+                break;
+        }
+    });
+    
+    for (int value : values) {
+        *out << value << endl;
+    }
+    
+    if (options.print_stats) {
+        // Nodes are in program order, which is a topological order
+        std::vector<int> depth(graph.size(), 1);
+        int longest = 0;
+        size_t edges = 0;
+        for (int node = 0; node < graph.size(); node++) {
+            longest = std::max(longest, depth[node]);
+            edges += graph.successors[node].size();
+            for (int successor : graph.successors[node]) {
+                depth[successor] = std::max(depth[successor], depth[node] + 1);
+            }
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "stats: parallel execute nodes=" << graph.size() << " edges=" << edges
+             << " critical-path=" << longest << " threads=" << options.threads
+             << " steals=" << pool.steals() << " ms=" << (long)ms << endl;
+    }
+}
+
+void Parser::report_profile()
+{
+    int poly_count = resident_polys ? resident_polys->size() : declarations.size();
+    std::vector<ProfileLabel> decl_labels(poly_count);
+    for (int handle = 0; handle < poly_count; handle++) {
+        const RichPolyDecl& poly = resident_polys ? resident_polys->decl(handle) : declarations[handle];
+        decl_labels[handle] = ProfileLabel{poly.name, poly.line_number};
+    }
+    
+    std::vector<std::string> variable_names(memory.size());
+    for (const auto& entry : symbol_table) {
+        variable_names[entry.second] = entry.first;
+    }
+    auto variable = [&](int index) {
+        return index >= 0 && index < (int)variable_names.size() ? variable_names[index] : std::string("?");
+    };
+    std::vector<ProfileLabel> statement_labels;
+    for (const Statement& stmt : program) {
+        std::string text;
+        switch (stmt.type) {
+            case STMT_INPUT:
+                text = "INPUT " + variable(stmt.var_index);
+                break;
+            case STMT_OUTPUT:
+                text = "OUTPUT " + variable(stmt.var_index);
+                break;
+            case STMT_ASSIGN:
+                text = variable(stmt.lhs_index) + " = ";
+                if (stmt.rhs_eval && stmt.rhs_eval->poly_index >= 0 && stmt.rhs_eval->poly_index < poly_count) {
+                    text += decl_labels[stmt.rhs_eval->poly_index].text + "(...)";
+                }
+                break;
+        }
+        statement_labels.push_back(ProfileLabel{text, stmt.line_number});
     }
+    profiler->report(cerr, decl_labels, statement_labels);
 }
 
 int Parser::evaluate_polynomial(const PolyEval* eval)
 {
-    if (!eval || eval->poly_index < 0 || eval->poly_index >= (int)rich_polynomials.size()) {
+    if (profiler) {
+        profiler->enter(eval ? eval->poly_index : -1);
+        int result = evaluate_call(eval);
+        profiler->leave();
+        return result;
+    }
+    return evaluate_call(eval);
+}
+
+int Parser::evaluate_call(const PolyEval* eval)
+{
+    int poly_count = resident_polys ? resident_polys->size() : declarations.size();
+    if (!eval || eval->poly_index < 0 || eval->poly_index >= poly_count) {
         return 0; // Error case
     }
     
-    const RichPolyDecl& poly = rich_polynomials[eval->poly_index];
+    const RichPolyDecl& poly = resident_polys ? resident_polys->decl(eval->poly_index)
+                                              : declarations[eval->poly_index];
+    
+    // Ensure we have the right number of argument values
+    if (eval->args.size() != poly.params.size()) {
+        return 0; // Argument count mismatch - should not happen after semantic checking
+    }
+    
+    FlatView view = poly_cache ? poly_cache->view() : poly.body.view();
+    uint32_t root = poly_cache ? poly_cache->decl(eval->poly_index).root_list : poly.body.root;
+    if (options.specialize_arity) {
+        switch (poly.params.size()) {
+            case 1: return evaluate_fixed<1>(eval, poly, view, root);
+            case 2: return evaluate_fixed<2>(eval, poly, view, root);
+            case 3: return evaluate_fixed<3>(eval, poly, view, root);
+            case 4: return evaluate_fixed<4>(eval, poly, view, root);
+            case 5: return evaluate_fixed<5>(eval, poly, view, root);
+            case 6: return evaluate_fixed<6>(eval, poly, view, root);
+            case 7: return evaluate_fixed<7>(eval, poly, view, root);
+            case 8: return evaluate_fixed<8>(eval, poly, view, root);
+        }
+    }
     
     // Evaluate all arguments
     std::vector<int> arg_values;
@@ -985,26 +2012,52 @@ int Parser::evaluate_polynomial(const PolyEval* eval)
         arg_values.push_back(evaluate_argument(arg));
     }
     
-    // Ensure we have the right number of argument values
-    if ((int)arg_values.size() != (int)poly.params.size()) {
-        return 0; // Argument count mismatch - should not happen after semantic checking
+    if (jit) {
+        JitFunction native = jit->function(eval->poly_index, view, root);
+        if (native) {
+            return evaluate_native(native, poly, view, root, arg_values.data());
+        }
+    }
+    if (const EvalPlan* plan = eval_state ? eval_state->plan(eval->poly_index) : nullptr) {
+        return plan->evaluate(arg_values.data());
+    }
+    return flat_evaluate(view, root, arg_values);
+}
+
+// evaluate_polynomial() for a declaration of N parameters: the arguments
+// stay on the stack and the body is evaluated by flat_evaluate_fixed<N>
+template <size_t N>
+int Parser::evaluate_fixed(const PolyEval* eval, const RichPolyDecl& poly, const FlatView& view, uint32_t root)
+{
+    std::array<int, N> arg_values;
+    for (size_t i = 0; i < N; i++) {
+        arg_values[i] = evaluate_argument(eval->args[i]);
     }
     
-    // Evaluate polynomial body (term list)
-    int result = 0;
-    bool first = true;
-    
-    for (const TermNode& term : poly.body) {
-        int term_value = evaluate_term(term, arg_values);
-        
-        if (first) {
-            result = (term.op == OP_MINUS) ? -term_value : term_value;
-            first = false;
-        } else {
-            result += (term.op == OP_PLUS) ? term_value : -term_value;
+    if (jit) {
+        JitFunction native = jit->function(eval->poly_index, view, root);
+        if (native) {
+            return evaluate_native(native, poly, view, root, arg_values.data());
+        }
+    }
+    if (const EvalPlan* plan = eval_state ? eval_state->plan(eval->poly_index) : nullptr) {
+        return plan->evaluate(arg_values.data());
+    }
+    return flat_evaluate_fixed(view, root, arg_values);
+}
+
+int Parser::evaluate_native(JitFunction native, const RichPolyDecl& poly, const FlatView& view, uint32_t root,
+                            const int* arg_values)
+{
+    int result = native(arg_values);
+    if (options.jit_verify) {
+        int expected = flat_evaluate(view, root, std::vector<int>(arg_values, arg_values + poly.params.size()));
+        if (result != expected) {
+            cerr << "jit mismatch: " << poly.name << " native=" << result
+                 << " interpreted=" << expected << endl;
+            return expected;
         }
     }
-    
     return result;
 }
 
@@ -1028,71 +2081,17 @@ int Parser::evaluate_argument(const PolyArgument& arg)
     }
 }
 
-int Parser::evaluate_term(const TermNode& term, const std::vector<int>& arg_values)
-{
-    if (term.kind == MLIST) {
-        // Monomial list term: coefficient * product of variable powers
-        int result = term.coefficient;
-        
-        for (int i = 0; i < (int)term.monomial_list.size() && i < (int)arg_values.size(); i++) {
-            if (term.monomial_list[i] > 0) {
-                result *= int_power(arg_values[i], term.monomial_list[i]);
-            }
-        }
-        
-        return result;
-    } else {
-        // PARENLIST - evaluate each parenthesized term list and multiply them
-        int result = 1;
-        
-        for (const std::vector<TermNode>& term_list : term.parenthesized_list) {
-            // Evaluate this term list
-            int term_list_value = 0;
-            bool first = true;
-            
-            for (const TermNode& inner_term : term_list) {
-                int inner_value = evaluate_term(inner_term, arg_values);
-                
-                if (first) {
-                    term_list_value = (inner_term.op == OP_MINUS) ? -inner_value : inner_value;
-                    first = false;
-                } else {
-                    term_list_value += (inner_term.op == OP_PLUS) ? inner_value : -inner_value;
-                }
-            }
-            
-            result *= term_list_value;
-        }
-        
-        return result;
-    }
-}
-
-int Parser::int_power(int base, int exp)
-{
-    int result = 1;
-    for (int i = 0; i < exp; i++) {
-        result *= base;
-    }
-    return result;
-}
-
 void Parser::execute_task_4()
 {
-    if (!rich_polynomials.empty()) {
-        cout << "POLY - COMBINED MONOMIAL LISTS" << endl;
-        
-        // Create a copy of polynomials and combine identical monomial lists
-        std::vector<RichPolyDecl> combined_polynomials;
-        
-        for (const auto& poly : rich_polynomials) {
-            RichPolyDecl combined_poly = poly;
-            combined_poly.body = combine_identical_monomials(poly.body, poly.params);
-            combined_polynomials.push_back(combined_poly);
-        }
+    if (!declarations.empty()) {
+        *out << "POLY - COMBINED MONOMIAL LISTS" << endl;
         
-        for (const auto& poly : combined_polynomials) {
-            cout << "\t" << format_poly_decl(poly) << ";" << endl;
+        // Combine identical monomial lists of the TermNode form of each body
+        for (int i = 0; i < declarations.size(); i++) {
+            *out << "\t" << format_poly_terms(declarations[i], combined_terms(i)) << ";" << endl;
+            if (!requested_tasks.count(5)) {
+                decl_forms[i] = DeclForms();
+            }
         }
     }
 }
@@ -1189,22 +2188,203 @@ bool Parser::monomials_are_identical(const std::vector<int>& mono1, const std::v
 
 void Parser::execute_task_5()
 {
-    if (!rich_polynomials.empty()) {
-        cout << "POLY - EXPANDED" << endl;
+    if (!declarations.empty()) {
+        *out << "POLY - EXPANDED" << endl;
+        
+        // Shared by all declarations
+        ExpansionCache cache;
+        if (options.cache_expansions) expansion_cache = &cache;
         
-        // Create expanded polynomials
-        std::vector<RichPolyDecl> expanded_polynomials;
+        for (int i = 0; i < declarations.size(); i++) {
+            const RichPolyDecl& poly = declarations[i];
+            const std::vector<TermNode>& terms = expansion_terms(i);
+            switch (choose_task5_strategy(poly, terms)) {
+                case TASK5_IN_MEMORY:
+                    *out << "\t" << format_poly_terms(poly, expand_polynomial(terms, poly.params)) << ";" << endl;
+                    break;
+                case TASK5_STREAMING:
+                    print_expanded_streaming(poly, terms);
+                    break;
+                case TASK5_REFUSED:
+                    break;
+            }
+            decl_forms[i] = DeclForms();
+        }
         
-        for (const auto& poly : rich_polynomials) {
-            RichPolyDecl expanded_poly = poly;
-            expanded_poly.body = expand_polynomial(poly.body, poly.params);
-            expanded_polynomials.push_back(expanded_poly);
+        expansion_cache = nullptr;
+        if (options.print_stats && options.cache_expansions) {
+            uint64_t lookups = cache.hits + cache.misses;
+            cerr << "stats: expansion-cache hits=" << cache.hits << " misses=" << cache.misses
+                 << " hit-rate=" << (lookups ? 100 * cache.hits / lookups : 0) << "%"
+                 << " cached-terms=" << cache.cached_terms
+                 << " saved-ms=" << (uint64_t)(cache.saved_seconds * 1000) << endl;
+        }
+    }
+}
+
+static uint64_t saturating_add(uint64_t a, uint64_t b)
+{
+    return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
+static uint64_t saturating_multiply(uint64_t a, uint64_t b)
+{
+    return (a != 0 && b > UINT64_MAX / a) ? UINT64_MAX : a * b;
+}
+
+// Bounds the expansion of a term list: a parenthesized term produces the
+// product of its factors' term counts and its exponent ranges are the sums
+// of the factors' ranges; a term list adds counts and unions ranges
+ExpansionEstimate Parser::estimate_expansion(const std::vector<TermNode>& terms, int param_count)
+{
+    ExpansionEstimate estimate;
+    estimate.products = 0;
+    estimate.min_powers.assign(param_count, INT32_MAX);
+    estimate.max_powers.assign(param_count, 0);
+    
+    for (const auto& term : terms) {
+        uint64_t products = 1;
+        std::vector<int> min_powers(param_count, 0), max_powers(param_count, 0);
+        if (term.kind == MLIST) {
+            for (int i = 0; i < param_count && i < (int)term.monomial_list.size(); i++) {
+                min_powers[i] = max_powers[i] = term.monomial_list[i];
+            }
+        } else {
+            for (const auto& paren_list : term.parenthesized_list) {
+                ExpansionEstimate factor = estimate_expansion(paren_list, param_count);
+                products = saturating_multiply(products, factor.products);
+                for (int i = 0; i < param_count; i++) {
+                    min_powers[i] += factor.min_powers[i];
+                    max_powers[i] += factor.max_powers[i];
+                }
+            }
         }
         
-        for (const auto& poly : expanded_polynomials) {
-            cout << "\t" << format_poly_decl(poly) << ";" << endl;
+        estimate.products = saturating_add(estimate.products, products);
+        for (int i = 0; i < param_count; i++) {
+            estimate.min_powers[i] = std::min(estimate.min_powers[i], min_powers[i]);
+            estimate.max_powers[i] = std::max(estimate.max_powers[i], max_powers[i]);
+        }
+    }
+    
+    // Distinct monomials are limited by the products and by the exponent box
+    uint64_t box = 1;
+    for (int i = 0; i < param_count; i++) {
+        box = saturating_multiply(box, (uint64_t)(estimate.max_powers[i] - estimate.min_powers[i]) + 1);
+    }
+    estimate.distinct = std::min(estimate.products, box);
+    
+    // Every product is a TermNode with its own exponent vector, and the
+    // list is copied once while terms are multiplied and combined
+    uint64_t term_bytes = sizeof(TermNode) + param_count * sizeof(int) + 16;
+    estimate.bytes = saturating_multiply(saturating_multiply(estimate.products, term_bytes), 2);
+    return estimate;
+}
+
+// Picks how a declaration is expanded, based on estimate_expansion() and
+// the budgets in options, and reports the decision
+Task5Strategy Parser::choose_task5_strategy(const RichPolyDecl& poly, const std::vector<TermNode>& body)
+{
+    ExpansionEstimate estimate = estimate_expansion(body, poly.params.size());
+    
+    Task5Strategy strategy = TASK5_IN_MEMORY;
+    if (options.task5_max_terms > 0 && estimate.products > options.task5_max_terms) {
+        strategy = TASK5_REFUSED;
+        cerr << "Task 5: " << poly.name << " not expanded: up to " << estimate.products
+             << " products exceed the limit of " << options.task5_max_terms << endl;
+    } else if (options.task5_memory_budget > 0 && estimate.bytes > options.task5_memory_budget) {
+        strategy = TASK5_STREAMING;
+    }
+    
+    if (options.print_stats) {
+        static const char* strategy_names[] = { "in-memory", "streaming", "refused" };
+        cerr << "stats: task5 " << poly.name
+             << " products=" << estimate.products
+             << " distinct<=" << estimate.distinct
+             << " bytes~" << estimate.bytes
+             << " strategy=" << strategy_names[strategy] << endl;
+    }
+    return strategy;
+}
+
+// Task 5 within options.task5_memory_budget: the products of each
+// parenthesized term are generated one at a time into a TermSpiller, which
+// combines, spills and merges them, and the result is printed as it is
+// merged. Only the (expanded) factors themselves are held in memory.
+void Parser::print_expanded_streaming(const RichPolyDecl& poly, const std::vector<TermNode>& body)
+{
+    TermSpiller spiller(poly.params.size(), options.task5_memory_budget);
+    std::vector<std::vector<int>> exponents;
+    
+    for (const auto& term : body) {
+        if (term.kind == MLIST) {
+            int coefficient = (term.op == OP_MINUS) ? -term.coefficient : term.coefficient;
+            spiller.add(coefficient, term.monomial_list.data());
+        } else {
+            std::vector<std::vector<TermNode>> factors;
+            for (const auto& paren_list : term.parenthesized_list) {
+                factors.push_back(expand_polynomial(paren_list, poly.params));
+            }
+            exponents.assign(factors.size() + 1, std::vector<int>(poly.params.size(), 0));
+            int coefficient = (term.op == OP_MINUS) ? -term.coefficient : term.coefficient;
+            spill_products(spiller, factors, 0, coefficient, exponents);
         }
     }
+    
+    // The header is printed with the first term, so that nothing is printed
+    // if the spilled terms cannot be written
+    TermNode output_term;
+    output_term.kind = MLIST;
+    bool first = true;
+    bool complete = spiller.finish([&](int coefficient, const int* powers) {
+        if (first) {
+            *out << "\t" << format_poly_header(poly);
+        }
+        output_term.op = (coefficient >= 0) ? OP_PLUS : OP_MINUS;
+        output_term.coefficient = (coefficient >= 0) ? coefficient : -coefficient;
+        output_term.monomial_list.assign(powers, powers + poly.params.size());
+        *out << format_term(output_term, poly.params, first);
+        first = false;
+    });
+    if (!complete && first) {
+        cerr << "Task 5: " << poly.name << " not expanded: cannot write temporary files" << endl;
+        return;
+    }
+    if (!complete) {
+        cerr << "Task 5: " << poly.name << " expansion incomplete: cannot read temporary files" << endl;
+    }
+    if (first) {
+        // Everything cancelled; print the zero term the same way as
+        // combine_identical_monomials() leaves it
+        *out << "\t" << format_poly_header(poly);
+        output_term.op = OP_PLUS;
+        output_term.coefficient = 0;
+        output_term.monomial_list.assign(poly.params.size(), 0);
+        *out << format_term(output_term, poly.params, true);
+    }
+    *out << ";" << endl;
+}
+
+// Adds every product of one term from each of factors[level..] times
+// `coefficient` and the monomial in exponents[level]
+void Parser::spill_products(TermSpiller& spiller, const std::vector<std::vector<TermNode>>& factors,
+                            int level, int coefficient, std::vector<std::vector<int>>& exponents)
+{
+    if (coefficient == 0) {
+        return;
+    }
+    if (level == (int)factors.size()) {
+        spiller.add(coefficient, exponents[level].data());
+        return;
+    }
+    
+    for (const auto& term : factors[level]) {
+        int term_coefficient = (term.op == OP_MINUS) ? -term.coefficient : term.coefficient;
+        for (size_t i = 0; i < exponents[level].size(); i++) {
+            exponents[level + 1][i] = exponents[level][i] + term.monomial_list[i];
+        }
+        spill_products(spiller, factors, level + 1, coefficient * term_coefficient, exponents);
+    }
 }
 
 std::vector<TermNode> Parser::expand_polynomial(const std::vector<TermNode>& terms, const std::vector<std::string>& params)
@@ -1223,8 +2403,19 @@ std::vector<TermNode> Parser::expand_polynomial(const std::vector<TermNode>& ter
         // Skip any unknown term kinds
     }
     
-    // Combine like terms after expansion
-    std::vector<TermNode> combined = combine_identical_monomials(expanded_terms, params);
+    // Combine like terms after expansion. All terms are monomial lists and
+    // are sorted next, so the hashed combine gives the same result as
+    // combine_identical_monomials() without its quadratic search
+    std::vector<TermNode> combined = combine_terms_hashed(expanded_terms);
+    if (combined.empty()) {
+        // Same single zero term combine_identical_monomials() leaves
+        TermNode zero_term;
+        zero_term.kind = MLIST;
+        zero_term.op = OP_PLUS;
+        zero_term.coefficient = 0;
+        zero_term.monomial_list.resize(params.size(), 0);
+        combined.push_back(zero_term);
+    }
     
     // Sort the terms to ensure consistent ordering
     sort_terms(combined, params);
@@ -1232,6 +2423,48 @@ std::vector<TermNode> Parser::expand_polynomial(const std::vector<TermNode>& ter
     return combined;
 }
 
+// Structural hash of the factors of a parenthesized term, consistent with
+// same_term_list()
+static size_t hash_term_list(const std::vector<TermNode>& terms, size_t hash)
+{
+    auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 1099511628211ULL; };
+    mix(terms.size());
+    for (const auto& term : terms) {
+        mix(((uint64_t)term.kind << 32) | ((uint64_t)term.op << 16));
+        mix((uint32_t)term.coefficient);
+        mix(term.monomial_list.size());
+        for (int power : term.monomial_list) mix((uint32_t)power);
+        mix(term.parenthesized_list.size());
+        for (const auto& factor : term.parenthesized_list) hash = hash_term_list(factor, hash);
+    }
+    return hash;
+}
+
+static size_t hash_factors(const std::vector<std::vector<TermNode>>& factors, size_t param_count)
+{
+    size_t hash = (14695981039346656037ULL ^ param_count) * 1099511628211ULL;
+    for (const auto& factor : factors) hash = hash_term_list(factor, hash);
+    return hash;
+}
+
+// Structural equality of two factors as written, including nested
+// parentheses; used to find repeated factors
+static bool same_term_list(const std::vector<TermNode>& a, const std::vector<TermNode>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].kind != b[i].kind || a[i].op != b[i].op || a[i].coefficient != b[i].coefficient ||
+            a[i].monomial_list != b[i].monomial_list ||
+            a[i].parenthesized_list.size() != b[i].parenthesized_list.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < a[i].parenthesized_list.size(); j++) {
+            if (!same_term_list(a[i].parenthesized_list[j], b[i].parenthesized_list[j])) return false;
+        }
+    }
+    return true;
+}
+
 std::vector<TermNode> Parser::expand_parenthesized_term(const TermNode& paren_term, const std::vector<std::string>& params)
 {
     std::vector<TermNode> result;
@@ -1240,26 +2473,22 @@ std::vector<TermNode> Parser::expand_parenthesized_term(const TermNode& paren_te
         return result;
     }
     
-    // First, recursively expand each parenthesized list
-    std::vector<std::vector<TermNode>> expanded_lists;
-    for (const auto& paren_list : paren_term.parenthesized_list) {
-        std::vector<TermNode> expanded_list;
-        for (const auto& term : paren_list) {
-            if (term.kind == PARENLIST) {
-                // Recursively expand nested parentheses
-                std::vector<TermNode> nested_expansion = expand_parenthesized_term(term, params);
-                expanded_list.insert(expanded_list.end(), nested_expansion.begin(), nested_expansion.end());
-            } else {
-                expanded_list.push_back(term);
-            }
-        }
-        expanded_lists.push_back(expanded_list);
-    }
-    
-    // Now multiply all the expanded lists together
-    std::vector<TermNode> current_expansion = expanded_lists[0];
-    for (size_t i = 1; i < expanded_lists.size(); i++) {
-        current_expansion = multiply_term_lists(current_expansion, expanded_lists[i], params);
+    std::vector<TermNode> current_expansion;
+    size_t hash = 0;
+    const ExpansionCache::Entry* cached = nullptr;
+    if (expansion_cache) {
+        hash = hash_factors(paren_term.parenthesized_list, params.size());
+        cached = expansion_cache->find(paren_term, params.size(), hash);
+    }
+    if (cached) {
+        current_expansion = cached->expansion;
+    } else if (expansion_cache) {
+        auto start = std::chrono::steady_clock::now();
+        current_expansion = combine_terms_hashed(multiply_factors(paren_term, params));
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        expansion_cache->insert(paren_term, params.size(), hash, current_expansion, elapsed.count());
+    } else {
+        current_expansion = multiply_factors(paren_term, params);
     }
     
     // Apply the operator and coefficient of the parenthesized term
@@ -1290,8 +2519,86 @@ std::vector<TermNode> Parser::expand_parenthesized_term(const TermNode& paren_te
     return current_expansion;
 }
 
+// Product of the factors of a parenthesized term, without its operator and
+// coefficient
+std::vector<TermNode> Parser::multiply_factors(const TermNode& paren_term, const std::vector<std::string>& params)
+{
+    // Group structurally identical factors; multiplication is commutative,
+    // so each distinct factor is expanded once and raised to its count
+    std::vector<const std::vector<TermNode>*> distinct_lists;
+    std::vector<int> multiplicities;
+    for (const auto& paren_list : paren_term.parenthesized_list) {
+        size_t i = 0;
+        while (i < distinct_lists.size() && !same_term_list(*distinct_lists[i], paren_list)) i++;
+        if (i == distinct_lists.size()) {
+            distinct_lists.push_back(&paren_list);
+            multiplicities.push_back(0);
+        }
+        multiplicities[i]++;
+    }
+    
+    // First, recursively expand each parenthesized list
+    std::vector<std::vector<TermNode>> expanded_lists;
+    int naive_multiplications = 0, power_multiplications = 0;
+    for (size_t d = 0; d < distinct_lists.size(); d++) {
+        const std::vector<TermNode>& paren_list = *distinct_lists[d];
+        std::vector<TermNode> expanded_list;
+        for (const auto& term : paren_list) {
+            if (term.kind == PARENLIST) {
+                // Recursively expand nested parentheses
+                std::vector<TermNode> nested_expansion = expand_parenthesized_term(term, params);
+                expanded_list.insert(expanded_list.end(), nested_expansion.begin(), nested_expansion.end());
+            } else {
+                expanded_list.push_back(term);
+            }
+        }
+        if (multiplicities[d] > 1) {
+            expanded_list = power_term_list(expanded_list, multiplicities[d], params);
+            naive_multiplications += multiplicities[d] - 1;
+            for (int k = multiplicities[d]; k > 1; k >>= 1) {
+                power_multiplications += (k & 1) ? 2 : 1;
+            }
+        }
+        expanded_lists.push_back(expanded_list);
+    }
+    
+    if (options.print_stats && naive_multiplications > 0) {
+        cerr << "stats: powering factors=" << paren_term.parenthesized_list.size()
+             << " distinct=" << distinct_lists.size()
+             << " repeated-multiplications=" << naive_multiplications
+             << " squaring-multiplications=" << power_multiplications << endl;
+    }
+    
+    // Now multiply all the expanded lists together
+    std::vector<TermNode> current_expansion;
+    if (options.mult_order == MULT_ORDER_PLANNED && expanded_lists.size() > 2) {
+        current_expansion = multiply_planned(expanded_lists, params);
+    } else {
+        current_expansion = expanded_lists[0];
+        for (size_t i = 1; i < expanded_lists.size(); i++) {
+            current_expansion = multiply_term_lists(current_expansion, expanded_lists[i], params);
+        }
+    }
+    
+    return current_expansion;
+}
+
+// Products at which multiply_term_lists() splits the work over options.threads
+#define PARALLEL_MULTIPLY_THRESHOLD 1000000
+
 std::vector<TermNode> Parser::multiply_term_lists(const std::vector<TermNode>& list1, const std::vector<TermNode>& list2, const std::vector<std::string>& params)
 {
+    if (options.mult_engine != MULT_SCHOOLBOOK) {
+        size_t length = dense_length(list1, list2, params.size());
+        if (length > 0 && (options.mult_engine == MULT_DENSE ||
+                           dense_is_profitable(length, list1.size(), list2.size()))) {
+            return multiply_dense(list1, list2, params.size(), length);
+        }
+    }
+    if (options.threads > 1 && (uint64_t)list1.size() * list2.size() >= PARALLEL_MULTIPLY_THRESHOLD) {
+        return multiply_term_lists_parallel(list1, list2, params);
+    }
+    
     std::vector<TermNode> result;
     
     for (const auto& term1 : list1) {
@@ -1339,12 +2646,387 @@ std::vector<TermNode> Parser::multiply_term_lists(const std::vector<TermNode>& l
     return result;
 }
 
+struct MonomialHash {
+    size_t operator()(const std::vector<int>& powers) const
+    {
+        size_t hash = 14695981039346656037ULL;
+        for (int power : powers) {
+            hash = (hash ^ (unsigned)power) * 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+
+// monomial_list → signed coefficient
+typedef std::unordered_map<std::vector<int>, int, MonomialHash> MonomialAccumulator;
+
+// Same products as multiply_term_lists(), but identical monomials are
+// already combined (zero terms dropped) and the order is unspecified; the
+// caller combines and sorts the final expansion anyway.
+//
+// Rows of list1 are split over the threads. Each thread accumulates into
+// one map per shard (monomial hash modulo thread count), then thread t
+// merges shard t of every thread and writes its terms to its own slice of
+// the result.
+std::vector<TermNode> Parser::multiply_term_lists_parallel(const std::vector<TermNode>& list1, const std::vector<TermNode>& list2, const std::vector<std::string>& params)
+{
+    auto start = std::chrono::steady_clock::now();
+    int thread_count = std::min<int>(options.threads, list1.size());
+    size_t param_count = params.size();
+    MonomialHash hash;
+    std::vector<std::vector<MonomialAccumulator>> shards(thread_count, std::vector<MonomialAccumulator>(thread_count));
+    
+    auto multiply_rows = [&](int t) {
+        size_t begin = list1.size() * t / thread_count;
+        size_t end = list1.size() * (t + 1) / thread_count;
+        std::vector<int> powers(param_count);
+        for (size_t i = begin; i < end; i++) {
+            const TermNode& term1 = list1[i];
+            if (term1.kind != MLIST) continue;
+            int coeff1 = (term1.op == OP_MINUS) ? -term1.coefficient : term1.coefficient;
+            for (const auto& term2 : list2) {
+                if (term2.kind != MLIST) continue;
+                int coeff2 = (term2.op == OP_MINUS) ? -term2.coefficient : term2.coefficient;
+                for (size_t k = 0; k < param_count; k++) {
+                    powers[k] = (k < term1.monomial_list.size() ? term1.monomial_list[k] : 0) +
+                                (k < term2.monomial_list.size() ? term2.monomial_list[k] : 0);
+                }
+                shards[t][hash(powers) % thread_count][powers] += coeff1 * coeff2;
+            }
+        }
+    };
+    
+    std::vector<std::vector<TermNode>> slices(thread_count);
+    auto merge_shard = [&](int s) {
+        MonomialAccumulator merged = std::move(shards[0][s]);
+        for (int t = 1; t < thread_count; t++) {
+            for (auto& entry : shards[t][s]) {
+                merged[entry.first] += entry.second;
+            }
+            MonomialAccumulator().swap(shards[t][s]);
+        }
+        for (auto& entry : merged) {
+            if (entry.second == 0) continue;
+            TermNode product;
+            product.kind = MLIST;
+            product.op = (entry.second > 0) ? OP_PLUS : OP_MINUS;
+            product.coefficient = (entry.second > 0) ? entry.second : -entry.second;
+            product.monomial_list = entry.first;
+            slices[s].push_back(std::move(product));
+        }
+    };
+    
+    auto run_on_threads = [thread_count](const std::function<void(int)>& work) {
+        std::vector<std::thread> workers;
+        for (int t = 1; t < thread_count; t++) {
+            workers.emplace_back(work, t);
+        }
+        work(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    };
+    run_on_threads(multiply_rows);
+    run_on_threads(merge_shard);
+    
+    std::vector<TermNode> result;
+    for (auto& slice : slices) {
+        std::move(slice.begin(), slice.end(), std::back_inserter(result));
+    }
+    
+    if (options.print_stats) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        cerr << "stats: parallel multiply " << list1.size() << "x" << list2.size()
+             << " threads=" << thread_count << " terms=" << result.size()
+             << " ms=" << elapsed.count() << endl;
+    }
+    return result;
+}
+
+// Combines identical monomials with a hash table, keeping the order of
+// first appearance and dropping zero terms. Unlike
+// combine_identical_monomials() it does not add a zero term to an empty
+// result; it is only used on intermediate products.
+std::vector<TermNode> Parser::combine_terms_hashed(const std::vector<TermNode>& terms)
+{
+    std::unordered_map<std::vector<int>, size_t, MonomialHash> position;
+    std::vector<int> coefficients;
+    std::vector<const TermNode*> firsts;
+    
+    for (const auto& term : terms) {
+        int coefficient = (term.op == OP_MINUS) ? -term.coefficient : term.coefficient;
+        auto inserted = position.emplace(term.monomial_list, firsts.size());
+        if (inserted.second) {
+            firsts.push_back(&term);
+            coefficients.push_back(coefficient);
+        } else {
+            coefficients[inserted.first->second] += coefficient;
+        }
+    }
+    
+    std::vector<TermNode> result;
+    for (size_t i = 0; i < firsts.size(); i++) {
+        if (coefficients[i] == 0) continue;
+        TermNode term = *firsts[i];
+        term.op = (coefficients[i] > 0) ? OP_PLUS : OP_MINUS;
+        term.coefficient = (coefficients[i] > 0) ? coefficients[i] : -coefficients[i];
+        result.push_back(term);
+    }
+    return result;
+}
+
+// Cached products are capped in total so that heavy reuse cannot hold
+// more than this many terms
+#define EXPANSION_CACHE_MAX_TERMS 4000000
+
+const ExpansionCache::Entry* ExpansionCache::find(const TermNode& term, size_t param_count, size_t hash)
+{
+    auto range = entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& entry = it->second;
+        if (entry.param_count != param_count ||
+            entry.term.parenthesized_list.size() != term.parenthesized_list.size()) {
+            continue;
+        }
+        bool same = true;
+        for (size_t i = 0; same && i < term.parenthesized_list.size(); i++) {
+            same = same_term_list(entry.term.parenthesized_list[i], term.parenthesized_list[i]);
+        }
+        if (same) {
+            hits++;
+            saved_seconds += entry.seconds;
+            return &entry;
+        }
+    }
+    misses++;
+    return nullptr;
+}
+
+void ExpansionCache::insert(const TermNode& term, size_t param_count, size_t hash,
+                            const std::vector<TermNode>& expansion, double seconds)
+{
+    if (cached_terms + expansion.size() > EXPANSION_CACHE_MAX_TERMS) return;
+    cached_terms += expansion.size();
+    entries.emplace(hash, Entry{term, param_count, expansion, seconds});
+}
+
+// list^exponent by repeated squaring, so a factor repeated k times costs
+// O(log k) multiplications instead of k - 1. Every product is combined
+// before it is multiplied again.
+std::vector<TermNode> Parser::power_term_list(const std::vector<TermNode>& list, int exponent, const std::vector<std::string>& params)
+{
+    std::vector<TermNode> base = combine_terms_hashed(list);
+    std::vector<TermNode> result;
+    bool have_result = false;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = have_result ? combine_terms_hashed(multiply_term_lists(result, base, params)) : base;
+            have_result = true;
+        }
+        exponent >>= 1;
+        if (exponent > 0) {
+            base = combine_terms_hashed(multiply_term_lists(base, base, params));
+        }
+    }
+    return result;
+}
+
+// Multiplies three or more factor lists, always taking next the pair whose
+// product is estimated to be smallest: the smaller of the product of their
+// sizes and the number of monomials their exponent ranges allow. Every
+// intermediate product is combined, so its size is what the next choice
+// sees. This is the commutative counterpart of matrix-chain ordering; the
+// final expansion is combined and sorted by the caller.
+std::vector<TermNode> Parser::multiply_planned(std::vector<std::vector<TermNode>>& lists, const std::vector<std::string>& params)
+{
+    size_t param_count = params.size();
+    size_t factor_count = lists.size();
+    std::vector<std::vector<int>> min_powers, max_powers;
+    auto compute_range = [&](size_t i) {
+        min_powers[i].assign(param_count, INT32_MAX);
+        max_powers[i].assign(param_count, 0);
+        for (const auto& term : lists[i]) {
+            for (size_t k = 0; k < param_count && k < term.monomial_list.size(); k++) {
+                min_powers[i][k] = std::min(min_powers[i][k], term.monomial_list[k]);
+                max_powers[i][k] = std::max(max_powers[i][k], term.monomial_list[k]);
+            }
+        }
+    };
+    
+    // What left-to-right multiplication without combining would produce
+    uint64_t left_to_right = 0, running = 1;
+    for (size_t i = 0; i < lists.size(); i++) {
+        running = saturating_multiply(running, lists[i].size());
+        if (i > 0) left_to_right = saturating_add(left_to_right, running);
+    }
+    
+    min_powers.resize(lists.size());
+    max_powers.resize(lists.size());
+    for (size_t i = 0; i < lists.size(); i++) {
+        lists[i] = combine_terms_hashed(lists[i]);
+        compute_range(i);
+    }
+    
+    uint64_t planned = 0;
+    while (lists.size() > 1) {
+        size_t best_i = 0, best_j = 1;
+        uint64_t best_size = UINT64_MAX;
+        for (size_t i = 0; i < lists.size(); i++) {
+            for (size_t j = i + 1; j < lists.size(); j++) {
+                uint64_t size = saturating_multiply(lists[i].size(), lists[j].size());
+                uint64_t box = 1;
+                for (size_t k = 0; k < param_count; k++) {
+                    if (lists[i].empty() || lists[j].empty()) break;
+                    int low = min_powers[i][k] + min_powers[j][k];
+                    int high = max_powers[i][k] + max_powers[j][k];
+                    box = saturating_multiply(box, (uint64_t)(high - low) + 1);
+                }
+                size = std::min(size, box);
+                if (size < best_size) {
+                    best_size = size;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        
+        lists[best_i] = combine_terms_hashed(multiply_term_lists(lists[best_i], lists[best_j], params));
+        planned = saturating_add(planned, lists[best_i].size());
+        compute_range(best_i);
+        lists.erase(lists.begin() + best_j);
+        min_powers.erase(min_powers.begin() + best_j);
+        max_powers.erase(max_powers.begin() + best_j);
+    }
+    
+    if (options.print_stats) {
+        cerr << "stats: mult-order factors=" << factor_count
+             << " left-to-right-terms=" << left_to_right
+             << " planned-terms=" << planned << endl;
+    }
+    return lists[0];
+}
+
+// Packed sort keys up to this many bits are sorted with radix_sort_keys()
+#define RADIX_SORT_MAX_BITS 64
+
+// Ascending LSD radix sort of (key, index) pairs on the low `bits` bits,
+// one byte per pass; passes in which every key has the same byte are skipped
+static void radix_sort_keys(std::vector<std::pair<uint64_t, uint32_t>>& keys, int bits)
+{
+    std::vector<std::pair<uint64_t, uint32_t>> buffer(keys.size());
+    for (int shift = 0; shift < bits; shift += 8) {
+        size_t counts[257] = {0};
+        for (const auto& key : keys) {
+            counts[((key.first >> shift) & 0xff) + 1]++;
+        }
+        if (counts[((keys[0].first >> shift) & 0xff) + 1] == keys.size()) {
+            continue;
+        }
+        for (int digit = 0; digit < 256; digit++) {
+            counts[digit + 1] += counts[digit];
+        }
+        for (const auto& key : keys) {
+            buffer[counts[(key.first >> shift) & 0xff]++] = key;
+        }
+        keys.swap(buffer);
+    }
+}
+
+static int bit_width(uint64_t value)
+{
+    int bits = 0;
+    while (value > 0) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+// Same order as term_less_than(), but every term's key (total degree, then
+// the powers in parameter order, all descending) is computed once. When the
+// key fits in RADIX_SORT_MAX_BITS it is packed into one integer and radix
+// sorted, otherwise the terms are sorted by their precomputed degrees.
 void Parser::sort_terms(std::vector<TermNode>& terms, const std::vector<std::string>& params)
 {
-    // Sort terms by their monomial signature for consistent ordering
-    std::sort(terms.begin(), terms.end(), [this, &params](const TermNode& a, const TermNode& b) {
-        return term_less_than(a, b, params);
-    });
+    auto start = std::chrono::steady_clock::now();
+    const char* method = "comparison";
+    int key_bits = 0;
+    
+    // Packing needs monomial lists of one length with nonnegative powers
+    // whose degrees fit in an int, as term_less_than() sums them in one
+    bool packable = options.term_sort == TERM_SORT_KEYED && terms.size() > 1;
+    size_t width = terms.empty() ? 0 : terms[0].monomial_list.size();
+    std::vector<int> degrees(packable ? terms.size() : 0);
+    int max_power = 0, max_degree = 0;
+    for (size_t i = 0; packable && i < terms.size(); i++) {
+        const TermNode& term = terms[i];
+        if (term.kind != MLIST || term.monomial_list.size() != width) {
+            packable = false;
+            break;
+        }
+        int64_t degree = 0;
+        for (int power : term.monomial_list) {
+            if (power < 0) packable = false;
+            max_power = std::max(max_power, power);
+            degree += power;
+        }
+        if (degree > INT32_MAX) packable = false;
+        degrees[i] = (int)degree;
+        max_degree = std::max(max_degree, degrees[i]);
+    }
+    
+    if (packable) {
+        int power_bits = bit_width(max_power);
+        int degree_bits = bit_width(max_degree);
+        key_bits = degree_bits + (int)width * power_bits;
+        
+        std::vector<uint32_t> order(terms.size());
+        if (key_bits <= RADIX_SORT_MAX_BITS) {
+            // Complemented fields, so ascending keys are descending terms
+            std::vector<std::pair<uint64_t, uint32_t>> keys(terms.size());
+            for (size_t i = 0; i < terms.size(); i++) {
+                uint64_t key = (uint64_t)(max_degree - degrees[i]);
+                for (int power : terms[i].monomial_list) {
+                    key = (key << power_bits) | (uint64_t)(max_power - power);
+                }
+                keys[i] = std::make_pair(key, (uint32_t)i);
+            }
+            radix_sort_keys(keys, key_bits);
+            for (size_t i = 0; i < keys.size(); i++) {
+                order[i] = keys[i].second;
+            }
+            method = "radix";
+        } else {
+            for (size_t i = 0; i < order.size(); i++) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&terms, &degrees](uint32_t a, uint32_t b) {
+                if (degrees[a] != degrees[b]) {
+                    return degrees[a] > degrees[b];
+                }
+                return terms[a].monomial_list > terms[b].monomial_list;
+            });
+            method = "keyed";
+        }
+        
+        std::vector<TermNode> sorted;
+        sorted.reserve(terms.size());
+        for (uint32_t index : order) {
+            sorted.push_back(std::move(terms[index]));
+        }
+        terms.swap(sorted);
+    } else {
+        // Sort terms by their monomial signature for consistent ordering
+        std::sort(terms.begin(), terms.end(), [this, &params](const TermNode& a, const TermNode& b) {
+            return term_less_than(a, b, params);
+        });
+    }
+    
+    if (options.print_stats && terms.size() > 1) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        cerr << "stats: sort terms=" << terms.size() << " method=" << method
+             << " key-bits=" << key_bits << " ms=" << elapsed.count() << endl;
+    }
 }
 
 bool Parser::term_less_than(const TermNode& a, const TermNode& b, const std::vector<std::string>& params)
@@ -1372,10 +3054,3 @@ bool Parser::term_less_than(const TermNode& a, const TermNode& b, const std::vec
     
     return a.monomial_list.size() < b.monomial_list.size();
 }
-
-int main()
-{
-    Parser parser;
-    parser.parse_program();
-    return 0;
-}
\ No newline at end of file
@@ -6,19 +6,89 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+#include <cstdint>
+#include <iostream>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <set>
 #include "lexer.h"
+#include "flatpoly.h"
 
-// Simple polynomial declaration for semantic checking
-struct PolyDecl {
-    std::string name;
-    std::vector<std::string> params;
-    int line_number;
+// Result of parse_program(); errors are reported on the parser's output
+// stream instead of terminating the process so that a Parser can be reused
+enum ParseStatus { PARSE_OK, PARSE_SYNTAX_ERROR, PARSE_SEMANTIC_ERROR };
+
+// Thrown by syntax_error() and caught in parse_program()
+struct SyntaxError {};
+
+class CompiledPolys;
+class EvalPlan;
+struct EvalState;
+class InputReader;
+class PolyCache;
+class PolyJit;
+class Profiler;
+
+typedef int (*JitFunction)(const int* args);  // see jit.h
+class TermSpiller;
+
+// Order in which the factors of a parenthesized term are multiplied
+enum MultOrder { MULT_ORDER_LEFT, MULT_ORDER_PLANNED };
+
+// How two term lists are multiplied: term by term, by dense Kronecker
+// substitution (see dense.h), or dense when it is estimated to be cheaper
+enum MultEngine { MULT_AUTO, MULT_SCHOOLBOOK, MULT_DENSE };
+
+// How sort_terms() orders the expanded terms of Task 5: by precomputed
+// keys (radix sorted when they are narrow) or with term_less_than()
+enum TermSort { TERM_SORT_KEYED, TERM_SORT_COMPARISON };
+
+// Run-time options, set from the command line (see main.cc)
+struct ParserOptions {
+    size_t task5_memory_budget;  // bytes of expanded terms per declaration, 0 = no limit;
+                                 // declarations estimated to need more are streamed
+    uint64_t task5_max_terms;    // refuse to expand declarations with more products, 0 = no limit
+    bool print_stats;            // write statistics to std::cerr
+    int threads;                 // worker threads for parallel work, 1 = sequential
+    MultOrder mult_order;
+    MultEngine mult_engine;
+    bool cache_expansions;       // share expansions of identical parenthesized terms in Task 5
+    TermSort term_sort;
+    bool check_only;             // parse_program() only checks the program (Task 1)
+    bool skip_dead_assignments;  // do not evaluate assignments whose value is never output
+    bool parallel_execute;       // run independent Task 2 statements on `threads` threads
+    bool parallel_poly;          // parse the POLY declarations on `threads` threads
+    int lex_threads;             // threads that lex a program read into memory, 0 = lex the stream
+    uint32_t jit_threshold;      // compile a declaration to native code after this many calls, 0 = never
+    bool jit_verify;             // also interpret every compiled call and report differences
+    bool specialize_arity;       // evaluate declarations of up to FLAT_MAX_FIXED_ARITY parameters
+                                 // with flat_evaluate_fixed()
+    bool cse_plans;              // evaluate declarations with an EvalPlan when it saves multiplications
+    bool profile;                // profile Task 2 (sequentially) and report to std::cerr
+
+    ParserOptions() : task5_memory_budget(0), task5_max_terms(0), print_stats(false), threads(1),
+                      mult_order(MULT_ORDER_PLANNED), mult_engine(MULT_AUTO), cache_expansions(true),
+                      term_sort(TERM_SORT_KEYED), check_only(false), skip_dead_assignments(true),
+                      parallel_execute(false), parallel_poly(false), lex_threads(0),
+                      jit_threshold(0), jit_verify(false), specialize_arity(true),
+                      cse_plans(true), profile(false) {}
+};
+
+// Size estimate of a Task 5 expansion, computed from the TermNode tree
+// before any multiplication is done
+struct ExpansionEstimate {
+    uint64_t products;            // terms produced before combining (saturates)
+    uint64_t distinct;            // upper bound on distinct monomials after combining
+    uint64_t bytes;               // estimated peak memory of the in-memory expansion
+    std::vector<int> min_powers;  // exponent range of every parameter
+    std::vector<int> max_powers;
 };
 
+enum Task5Strategy { TASK5_IN_MEMORY, TASK5_STREAMING, TASK5_REFUSED };
+
 // Rich data structures for polynomial representation (Task 3+)
 enum TermKind { MLIST, PARENLIST };
 enum OpType { OP_PLUS, OP_MINUS };
@@ -37,19 +107,28 @@ struct PolyArgument {
 };
 
 struct PolyEval {
-    int poly_index;                  // index into rich_polynomials
+    int poly_index;                  // handle in the parser's DeclStore
     std::vector<PolyArgument> args;
     
     PolyEval() : poly_index(-1) {}
 };
 
+// Frees a PolyEval together with the calls nested in its arguments. A call
+// is held by a PolyEvalPtr until it is attached to a statement, so a syntax
+// error thrown while it is being parsed does not leak it.
+struct PolyEvalDeleter {
+    void operator()(PolyEval* eval) const;
+};
+typedef std::unique_ptr<PolyEval, PolyEvalDeleter> PolyEvalPtr;
+
 struct Statement {
     StmtType type;
     int var_index;      // for INPUT/OUTPUT: variable location
     int lhs_index;      // for ASSIGN: LHS variable location
     PolyEval* rhs_eval; // for ASSIGN: RHS polynomial evaluation
+    int line_number;
     
-    Statement() : type(STMT_INPUT), var_index(-1), lhs_index(-1), rhs_eval(nullptr) {}
+    Statement() : type(STMT_INPUT), var_index(-1), lhs_index(-1), rhs_eval(nullptr), line_number(0) {}
 };
 
 struct TermNode {
@@ -65,17 +144,104 @@ struct TermNode {
 struct RichPolyDecl {
     std::string name;
     std::vector<std::string> params;
-    std::vector<TermNode> body;
+    FlatBody body;
     int line_number;
     bool has_explicit_params;  // true if parameters were explicitly specified with parentheses
 };
 
+// The declarations of a POLY section in declaration order; the single copy
+// used by the semantic checks, Task 2 and Tasks 3-5. A declaration is
+// identified by its handle, its position in the store. Declarations are
+// kept in fixed-size chunks that are never reallocated, so references stay
+// valid while more declarations are added.
+class DeclStore {
+  public:
+    DeclStore() : count(0) {}
+
+    // Appends a declaration and returns its handle
+    int add(RichPolyDecl decl);
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    RichPolyDecl& operator[](int handle) { return chunks[handle / CHUNK_SIZE][handle % CHUNK_SIZE]; }
+    const RichPolyDecl& operator[](int handle) const { return chunks[handle / CHUNK_SIZE][handle % CHUNK_SIZE]; }
+
+    // Handle of the first declaration called `name`, or -1
+    int find(const std::string& name) const;
+    void clear();
+
+  private:
+    static const int CHUNK_SIZE = 64;
+    std::vector<std::vector<RichPolyDecl>> chunks;
+    std::unordered_map<std::string, int> first_by_name;
+    int count;
+};
+
+// Forms of one declaration that Tasks 4 and 5 work on, computed on first
+// use and each built from the previous one (see Parser::combined_terms())
+struct DeclForms {
+    bool has_terms = false;
+    bool has_combined = false;
+    std::vector<TermNode> terms;     // TermNode form of the body, as printed by Task 3
+    std::vector<TermNode> combined;  // identical monomial lists combined (Task 4)
+};
+
+// Combined products of parenthesized terms, shared by all declarations
+// expanded by one execute_task_5(). Terms are keyed by the structure of
+// their factors and the parameter count: powers are aligned to the
+// parameter list, so the same structure expands the same way whatever the
+// parameters are called. Operator and coefficient of the term itself are
+// applied after the lookup, so they are not part of the key.
+struct ExpansionCache {
+    struct Entry {
+        TermNode term;                     // copy of the first occurrence
+        size_t param_count;
+        std::vector<TermNode> expansion;
+        double seconds;                    // time it took to compute
+    };
+    std::unordered_multimap<size_t, Entry> entries;
+    size_t cached_terms = 0;
+    uint64_t hits = 0, misses = 0;
+    double saved_seconds = 0;              // sum of the compute times of all hits
+
+    const Entry* find(const TermNode& term, size_t param_count, size_t hash);
+    void insert(const TermNode& term, size_t param_count, size_t hash,
+                const std::vector<TermNode>& expansion, double seconds);
+};
+
 class Parser {
   public:
-    void parse_program();
+    Parser();                                    // reads std::cin, writes std::cout
+    Parser(std::istream& in, std::ostream& out);
+    ~Parser();
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+
+    // Re-targets the parser at a new program; all state from the previous
+    // program is released
+    void reset(std::istream& in, std::ostream& out);
+    void set_options(const ParserOptions& options);
+    ParseStatus parse_program();
+    ParseStatus parse_program_with_cache(const std::string& source, const std::string& cache_path);
+    ParseStatus parse_program_streaming(std::istream& in);
+    ParseStatus parse_program_source(const std::string& source);
+    
+    // Library entry points (see polylib.h)
+    ParseStatus parse_poly_library();
+    bool first_semantic_error(std::string& code, std::vector<int>& lines);
+    DeclStore take_polynomials();
+    
+    // Server entry points (see server.h); the polynomials must outlive the parser
+    void use_resident_polys(const CompiledPolys* polys);
+    ParseStatus parse_request();
 
   private:
     LexicalAnalyzer lexer;
+    std::ostream* out;  // where task output and error messages are written
+    ParserOptions options;
+    const CompiledPolys* resident_polys; // if set, replaces the POLY section
+    const PolyCache* poly_cache;  // if set, the POLY section comes from this cache
+    int poly_cache_line;          // line on which the cached section starts
+    ExpansionCache* expansion_cache;  // set while execute_task_5() runs
     void syntax_error();
     Token expect(TokenType expected_type);
     
@@ -83,17 +249,23 @@ class Parser {
     std::set<int> requested_tasks;
     
     // Data structures for semantic checking
-    std::vector<PolyDecl> polynomials;
     std::map<std::string, std::vector<int>> duplicate_lines; // name -> line numbers
     std::vector<int> im4_errors;  // line numbers for IM-4 errors
     std::vector<int> aup13_errors; // line numbers for AUP-13 errors  
     std::vector<int> na7_errors;  // line numbers for NA-7 errors
-    PolyDecl* current_poly; // for checking monomial names during body parsing
     bool has_semantic_errors;
     
-    // Rich polynomial representation for Task 3+
-    std::vector<RichPolyDecl> rich_polynomials;
-    RichPolyDecl* current_rich_poly;
+    // What is built while parsing beyond what the semantic checks need
+    // (see plan_ir()); everything unless parse_program() decides otherwise
+    bool build_bodies;   // declaration bodies
+    bool build_program;  // EXECUTE statements and variables
+    bool build_inputs;   // INPUTS values
+    
+    // Declarations of the POLY section
+    DeclStore declarations;
+    int current_decl;  // handle of the declaration whose body is being parsed, -1 outside
+    std::vector<DeclForms> decl_forms;  // by handle, filled by execute_tasks()
+    uint64_t forms_reused;              // Task 5 expansions that started from Task 4's result
     
     // Task 2 - Program execution data structures
     std::vector<Statement> program;           // list of statements to execute
@@ -101,27 +273,51 @@ class Parser {
     std::vector<int> memory;                  // memory for variables (mem[])
     std::vector<int> inputs;                  // input values from INPUTS section
     int next_input;                           // index of next input to read
+    InputReader* input_reader;                // where INPUT reads from instead of inputs, if set
+    std::unique_ptr<EvalState> own_eval_state;  // of declarations, built by the first Task 2
+    const EvalState* eval_state;              // of the declarations Task 2 runs against, while it runs
+    PolyJit* jit;                             // eval_state->jit while Task 2 runs
+    Profiler* profiler;                       // profiles Task 2, if set
     int next_location;                        // next available memory location
     
+    void clear_state();
+    void plan_ir();
+    void load_cached_polys();
+    void materialize_cached_bodies();
+    bool poly_section_valid();
+    void clear_program();
+    void free_poly_eval(PolyEval* eval);
+    
     // Semantic checking functions
     void check_semantic_errors();
     void output_semantic_errors();
     bool is_valid_monomial(const std::string& name);
-    PolyDecl* find_polynomial(const std::string& name);
     
     // Task execution functions
     void execute_tasks();
+    void print_body_stats();
+    const std::vector<TermNode>& normalized_terms(int handle);
+    const std::vector<TermNode>& combined_terms(int handle);
+    const std::vector<TermNode>& expansion_terms(int handle);
     void execute_task_2(); // Program execution
+    void execute_task_2_parallel(const std::vector<bool>& dead);
+    const EvalState* prepare_eval_state();
+    void finish_task_2();
+    void report_profile();
     void execute_task_3(); // Sort and combine monomials
     void execute_task_4(); // Combine identical monomial lists
     void execute_task_5(); // Polynomial expansion and simplification
     
     // Task 2 helper functions
     int get_or_create_variable(const std::string& name);
+    std::vector<bool> find_dead_assignments();
     int evaluate_polynomial(const PolyEval* eval);
+    int evaluate_call(const PolyEval* eval);
+    template <size_t N>
+    int evaluate_fixed(const PolyEval* eval, const RichPolyDecl& poly, const FlatView& view, uint32_t root);
+    int evaluate_native(JitFunction native, const RichPolyDecl& poly, const FlatView& view, uint32_t root,
+                        const int* arg_values);
     int evaluate_argument(const PolyArgument& arg);
-    int evaluate_term(const TermNode& term, const std::vector<int>& arg_values);
-    int int_power(int base, int exp);
     PolyEval* parse_poly_evaluation_return();
     PolyArgument parse_argument_return();
     void parse_argument_list_return(std::vector<PolyArgument>& args);
@@ -134,8 +330,18 @@ class Parser {
     std::vector<TermNode> expand_polynomial(const std::vector<TermNode>& terms, const std::vector<std::string>& params);
     std::vector<TermNode> expand_parenthesized_term(const TermNode& paren_term, const std::vector<std::string>& params);
     std::vector<TermNode> multiply_term_lists(const std::vector<TermNode>& list1, const std::vector<TermNode>& list2, const std::vector<std::string>& params);
+    std::vector<TermNode> multiply_factors(const TermNode& paren_term, const std::vector<std::string>& params);
+    std::vector<TermNode> power_term_list(const std::vector<TermNode>& list, int exponent, const std::vector<std::string>& params);
+    std::vector<TermNode> multiply_planned(std::vector<std::vector<TermNode>>& lists, const std::vector<std::string>& params);
+    std::vector<TermNode> combine_terms_hashed(const std::vector<TermNode>& terms);
+    std::vector<TermNode> multiply_term_lists_parallel(const std::vector<TermNode>& list1, const std::vector<TermNode>& list2, const std::vector<std::string>& params);
     void sort_terms(std::vector<TermNode>& terms, const std::vector<std::string>& params);
     bool term_less_than(const TermNode& a, const TermNode& b, const std::vector<std::string>& params);
+    ExpansionEstimate estimate_expansion(const std::vector<TermNode>& terms, int param_count);
+    Task5Strategy choose_task5_strategy(const RichPolyDecl& poly, const std::vector<TermNode>& body);
+    void print_expanded_streaming(const RichPolyDecl& poly, const std::vector<TermNode>& body);
+    void spill_products(TermSpiller& spiller, const std::vector<std::vector<TermNode>>& factors,
+                        int level, int coefficient, std::vector<std::vector<int>>& exponents);
     
     // Parsing functions for each nonterminal
     void parse_tasks_section();
@@ -143,6 +349,7 @@ class Parser {
     void parse_inputs_num_list(); // separate function for INPUTS section
     void parse_poly_section();
     void parse_poly_decl_list();
+    void parse_poly_decl_list_parallel();
     void parse_poly_decl();
     void parse_poly_header();
     void parse_id_list();
@@ -170,19 +377,23 @@ class Parser {
     void parse_inputs_section();
     
     // Rich parsing functions for Tasks 3+
-    void parse_rich_poly_body(std::vector<TermNode>& terms);
-    void parse_rich_term_list(std::vector<TermNode>& terms);
-    void parse_rich_term(TermNode& term);
+    void parse_rich_poly_body(FlatBody& body);
+    FlatList parse_rich_term_list(FlatBody& body);
+    void parse_rich_term(FlatBody& body, FlatTerm& term);
     void parse_rich_monomial_list(std::vector<int>& powers);
     int parse_rich_coefficient();
-    void parse_rich_parenthesized_list(std::vector<std::vector<TermNode>>& paren_list);
+    void parse_rich_parenthesized_list(FlatBody& body, std::vector<FlatList>& factors);
     
     // Helper functions for Task 3
     void combine_and_sort_monomials();
     void print_task3_output();
-    std::string format_monomial_list(const std::vector<int>& powers, const std::vector<std::string>& params);
+    std::string format_monomial_list(const int* powers, size_t count, const std::vector<std::string>& params);
     std::string format_term(const TermNode& term, const std::vector<std::string>& params, bool is_first);
+    std::string format_flat_term(const FlatView& view, const FlatTerm& term, const std::vector<std::string>& params, bool is_first);
+    std::string format_flat_list(const FlatView& view, uint32_t list, const std::vector<std::string>& params);
     std::string format_poly_decl(const RichPolyDecl& poly);
+    std::string format_poly_terms(const RichPolyDecl& poly, const std::vector<TermNode>& body);
+    std::string format_poly_header(const RichPolyDecl& poly);
     std::string format_parenthesized_list(const std::vector<std::vector<TermNode>>& paren_list, const std::vector<std::string>& params);
 };
 
@@ -0,0 +1,243 @@
+/*
+ * Binary cache of a validated POLY section, see polycache.h
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "polycache.h"
+
+using namespace std;
+
+PolyCache::PolyCache() : data(nullptr), size(0), header(nullptr), decls(nullptr),
+                         param_names(nullptr), strings(nullptr)
+{
+}
+
+PolyCache::~PolyCache()
+{
+    if (data) {
+        munmap(data, size);
+    }
+}
+
+bool PolyCache::open(const string& path, uint64_t source_hash)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PolyCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    data = mapping;
+    size = st.st_size;
+    const char* base = (const char*)data;
+    header = (const PolyCacheHeader*)base;
+    if (memcmp(header->magic, "PLYC", 4) != 0 || header->version != POLY_CACHE_VERSION ||
+        header->source_hash != source_hash || header->file_size != size) {
+        return false;
+    }
+
+    decls = (const PolyCacheDecl*)(base + header->decl_offset);
+    param_names = (const PolyCacheString*)(base + header->param_offset);
+    strings = base + header->string_offset;
+    flat.lists = (const FlatList*)(base + header->list_offset);
+    flat.terms = (const FlatTerm*)(base + header->term_offset);
+    flat.exps = (const int32_t*)(base + header->exp_offset);
+    return validate();
+}
+
+vector<string> PolyCache::params(int index) const
+{
+    vector<string> result;
+    const PolyCacheDecl& d = decls[index];
+    for (uint32_t i = 0; i < d.param_count; i++) {
+        result.push_back(string_at(param_names[d.first_param + i]));
+    }
+    return result;
+}
+
+static bool block_fits(uint64_t offset, uint64_t count, uint64_t record_size, uint64_t file_size)
+{
+    return offset % 4 == 0 && offset + count * record_size <= file_size;
+}
+
+// Bounds checks only; the records themselves are used as they are. A file
+// that fails them is treated like a stale one and rebuilt.
+bool PolyCache::validate() const
+{
+    const PolyCacheHeader& h = *header;
+    if (!block_fits(h.decl_offset, h.decl_count, sizeof(PolyCacheDecl), size) ||
+        !block_fits(h.param_offset, h.param_count, sizeof(PolyCacheString), size) ||
+        !block_fits(h.list_offset, h.list_count, sizeof(FlatList), size) ||
+        !block_fits(h.term_offset, h.term_count, sizeof(FlatTerm), size) ||
+        !block_fits(h.exp_offset, h.exp_count, sizeof(int32_t), size) ||
+        (uint64_t)h.string_offset + h.string_size > size) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < h.param_count; i++) {
+        if ((uint64_t)param_names[i].offset + param_names[i].length > h.string_size) return false;
+    }
+    // Factor lists are always stored after the list that contains them,
+    // which also rules out cycles. Walking the lists backwards gives every
+    // list the number of arguments its monomials read, factors included.
+    vector<uint32_t> width(h.list_count, 0);
+    for (uint32_t i = h.list_count; i-- > 0;) {
+        const FlatList& list = flat.lists[i];
+        if ((uint64_t)list.first_term + list.term_count > h.term_count) return false;
+        for (uint32_t j = 0; j < list.term_count; j++) {
+            const FlatTerm& t = flat.terms[list.first_term + j];
+            if (t.kind > PARENLIST || t.op > OP_MINUS) return false;
+            if (t.kind == MLIST) {
+                if ((uint64_t)t.first + t.count > h.exp_count) return false;
+                for (uint32_t k = 0; k < t.count; k++) {
+                    if (flat.exps[t.first + k] < 0) return false;
+                }
+                width[i] = max(width[i], t.count);
+            } else {
+                if (t.first <= i || (uint64_t)t.first + t.count > h.list_count) return false;
+                for (uint32_t k = 0; k < t.count; k++) {
+                    width[i] = max(width[i], width[t.first + k]);
+                }
+            }
+        }
+    }
+    // Evaluation passes one argument per parameter, so a body must not read
+    // more than that
+    for (uint32_t i = 0; i < h.decl_count; i++) {
+        const PolyCacheDecl& d = decls[i];
+        if ((uint64_t)d.name.offset + d.name.length > h.string_size ||
+            (uint64_t)d.first_param + d.param_count > h.param_count ||
+            d.root_list >= h.list_count || width[d.root_list] > d.param_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+static uint32_t append_block(string& file, const T* records, size_t count)
+{
+    while (file.size() % 4 != 0) file += '\0';
+    uint32_t offset = file.size();
+    file.append((const char*)records, count * sizeof(T));
+    return offset;
+}
+
+bool write_poly_cache(const string& path, uint64_t source_hash,
+                      const DeclStore& decls, int section_line)
+{
+    FlatBuilder builder;
+    vector<PolyCacheDecl> records;
+    vector<PolyCacheString> params;
+    string strings;
+
+    auto add_string = [&strings](const string& s) {
+        PolyCacheString result;
+        result.offset = strings.size();
+        result.length = s.size();
+        strings += s;
+        return result;
+    };
+
+    for (int i = 0; i < decls.size(); i++) {
+        const RichPolyDecl& poly = decls[i];
+        PolyCacheDecl record;
+        record.name = add_string(poly.name);
+        record.first_param = params.size();
+        record.param_count = poly.params.size();
+        for (const string& param : poly.params) {
+            params.push_back(add_string(param));
+        }
+        record.root_list = builder.add_list(poly.body.view(), poly.body.root);
+        record.line_offset = poly.line_number - section_line;
+        record.has_explicit_params = poly.has_explicit_params;
+        records.push_back(record);
+    }
+
+    PolyCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    string file(sizeof(header), '\0');
+    header.decl_count = records.size();
+    header.decl_offset = append_block(file, records.data(), records.size());
+    header.param_count = params.size();
+    header.param_offset = append_block(file, params.data(), params.size());
+    header.list_count = builder.lists.size();
+    header.list_offset = append_block(file, builder.lists.data(), builder.lists.size());
+    header.term_count = builder.terms.size();
+    header.term_offset = append_block(file, builder.terms.data(), builder.terms.size());
+    header.exp_count = builder.exps.size();
+    header.exp_offset = append_block(file, builder.exps.data(), builder.exps.size());
+    header.string_size = strings.size();
+    header.string_offset = append_block(file, strings.data(), strings.size());
+
+    memcpy(header.magic, "PLYC", 4);
+    header.version = POLY_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.file_size = file.size();
+    memcpy(&file[0], &header, sizeof(header));
+
+    string temp_path = path + ".tmp" + to_string(getpid());
+    FILE* f = fopen(temp_path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(file.data(), 1, file.size(), f) == file.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+        remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint64_t hash_poly_source(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Splits the text into words the way the lexer does (an ID starts with a
+// letter and continues with letters and digits, a NUM is a run of digits)
+// without building tokens
+bool find_poly_section(const string& source, size_t& begin, size_t& end)
+{
+    bool seen_poly = false;
+    size_t i = 0;
+    while (i < source.size()) {
+        unsigned char c = source[i];
+        if (isalpha(c)) {
+            size_t start = i;
+            while (i < source.size() && isalnum((unsigned char)source[i])) i++;
+            if (!seen_poly && source.compare(start, i - start, "POLY") == 0) {
+                seen_poly = true;
+                begin = i;
+            } else if (seen_poly && source.compare(start, i - start, "EXECUTE") == 0) {
+                end = start;
+                return true;
+            }
+        } else if (isdigit(c)) {
+            while (i < source.size() && isdigit((unsigned char)source[i])) i++;
+        } else {
+            i++;
+        }
+    }
+    return false;
+}
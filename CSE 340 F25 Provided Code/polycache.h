@@ -0,0 +1,103 @@
+/*
+ * Binary cache of a validated POLY section
+ *
+ * The file is written after a run whose POLY section had no syntax, DMT-12
+ * or IM-4 errors and is keyed by a hash of the section's source text. A
+ * later run with the same section maps the file and uses it in place: the
+ * lexer skips the section and Task 2 evaluates straight from the mapped
+ * FlatTerm records (see flatpoly.h).
+ *
+ * Layout (native endianness, every offset is from the start of the file and
+ * every block is 4-byte aligned):
+ *
+ *   PolyCacheHeader
+ *   PolyCacheDecl[decl_count]
+ *   PolyCacheString[param_count]     parameter names of all declarations
+ *   FlatList[list_count]
+ *   FlatTerm[term_count]
+ *   int32_t[exp_count]               exponent pool
+ *   char[string_size]                names, not NUL terminated
+ */
+#ifndef __POLYCACHE__H__
+#define __POLYCACHE__H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "parser.h"
+#include "flatpoly.h"
+
+#define POLY_CACHE_VERSION 1
+
+struct PolyCacheString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct PolyCacheDecl {
+    PolyCacheString name;
+    uint32_t first_param;
+    uint32_t param_count;
+    uint32_t root_list;
+    int32_t line_offset;           // line_number relative to the section's first line
+    uint32_t has_explicit_params;
+};
+
+struct PolyCacheHeader {
+    char magic[4];                 // "PLYC"
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t file_size;
+    uint32_t decl_count, decl_offset;
+    uint32_t param_count, param_offset;
+    uint32_t list_count, list_offset;
+    uint32_t term_count, term_offset;
+    uint32_t exp_count, exp_offset;
+    uint32_t string_size, string_offset;
+};
+
+class PolyCache {
+  public:
+    PolyCache();
+    ~PolyCache();
+    PolyCache(const PolyCache&) = delete;
+    PolyCache& operator=(const PolyCache&) = delete;
+
+    // Maps the file; fails if it is missing, malformed, of another version
+    // or was built from a different source
+    bool open(const std::string& path, uint64_t source_hash);
+
+    int decl_count() const { return header->decl_count; }
+    const PolyCacheDecl& decl(int index) const { return decls[index]; }
+    std::string name(int index) const { return string_at(decls[index].name); }
+    std::vector<std::string> params(int index) const;
+    FlatView view() const { return flat; }
+
+  private:
+    void* data;
+    size_t size;
+    const PolyCacheHeader* header;
+    const PolyCacheDecl* decls;
+    const PolyCacheString* param_names;
+    const char* strings;
+    FlatView flat;
+
+    std::string string_at(const PolyCacheString& s) const { return std::string(strings + s.offset, s.length); }
+    bool validate() const;
+};
+
+// Writes the cache atomically (temporary file + rename); section_line is
+// the line on which the section's source text starts
+bool write_poly_cache(const std::string& path, uint64_t source_hash,
+                      const DeclStore& decls, int section_line);
+
+// 64-bit FNV-1a
+uint64_t hash_poly_source(const char* data, size_t size);
+
+// Finds the POLY section's declarations in a program's source text:
+// [begin, end) runs from just after the POLY keyword to the EXECUTE keyword
+bool find_poly_section(const std::string& source, size_t& begin, size_t& end);
+
+#endif  //__POLYCACHE__H__
@@ -0,0 +1,88 @@
+/*
+ * Embeddable polynomial library, see polylib.h
+ */
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "polylib.h"
+#include "jit.h"
+
+using namespace std;
+
+CompiledPolys::CompiledPolys(DeclStore decls, const ParserOptions& options) : decls(std::move(decls))
+{
+    int count = this->decls.size();
+    if (options.cse_plans) {
+        for (int handle = 0; handle < count; handle++) {
+            const RichPolyDecl& poly = this->decls[handle];
+            state.add_plan(handle, poly.body.view(), poly.body.root, poly.params.size());
+        }
+    }
+    if (options.jit_threshold > 0 && jit_supported()) {
+        state.jit.reset(new PolyJit(count, options.jit_threshold));
+    }
+}
+
+PolyEvalStatus CompiledPolys::evaluate(const string& name, const vector<int>& args, int& result) const
+{
+    int index = find(name);
+    if (index < 0) {
+        return EVAL_UNKNOWN_POLY;
+    }
+    return evaluate(index, args, result);
+}
+
+PolyEvalStatus CompiledPolys::evaluate(int index, const vector<int>& args, int& result) const
+{
+    if (index < 0 || index >= decls.size()) {
+        return EVAL_UNKNOWN_POLY;
+    }
+    if (args.size() != decls[index].params.size()) {
+        return EVAL_WRONG_ARG_COUNT;
+    }
+    if (const EvalPlan* plan = state.plan(index)) {
+        result = plan->evaluate(args.data());
+    } else {
+        result = flat_evaluate(decls[index].body.view(), decls[index].body.root, args);
+    }
+    return EVAL_OK;
+}
+
+PolyCompileResult compile_poly_section(const string& source, const ParserOptions& options)
+{
+    PolyCompileResult result;
+    istringstream in(source);
+    ostringstream messages;
+    Parser parser(in, messages);
+
+    switch (parser.parse_poly_library()) {
+        case PARSE_SYNTAX_ERROR:
+            result.error.kind = POLY_SYNTAX_ERROR;
+            result.error.message = messages.str();
+            break;
+
+        case PARSE_SEMANTIC_ERROR: {
+            result.error.kind = POLY_SEMANTIC_ERROR;
+            parser.first_semantic_error(result.error.code, result.error.lines);
+            ostringstream message;
+            message << "Semantic Error Code " << result.error.code << ":";
+            for (int line : result.error.lines) {
+                message << " " << line;
+            }
+            message << "\n";
+            result.error.message = message.str();
+            break;
+        }
+
+        case PARSE_OK:
+            result.polys = make_shared<const CompiledPolys>(parser.take_polynomials(), options);
+            break;
+    }
+    return result;
+}
+
+PolyCompileResult compile_poly_section(const char* data, size_t size, const ParserOptions& options)
+{
+    return compile_poly_section(string(data, size), options);
+}
@@ -0,0 +1,84 @@
+/*
+ * Embeddable polynomial library
+ *
+ * Compiles a POLY section held in memory into an immutable CompiledPolys
+ * object that can be shared by any number of threads. Nothing in this API
+ * writes to std::cout or terminates the process; errors are returned as
+ * values.
+ *
+ * The library consists of every source file except main.cc (batch.cc and
+ * server.cc are only used by the command line tool and may be left out).
+ * The worker pool uses threads, so programs are linked with -pthread:
+ *
+ *   g++ -std=c++17 -O2 -c batch.cc dense.cc evalplan.cc flatpoly.cc \
+ *       inputbuf.cc inputreader.cc jit.cc lexer.cc parser.cc polycache.cc \
+ *       polylib.cc profiler.cc server.cc spill.cc workpool.cc
+ *   ar rcs libpoly.a batch.o dense.o evalplan.o flatpoly.o inputbuf.o \
+ *       inputreader.o jit.o lexer.o parser.o polycache.o polylib.o \
+ *       profiler.o server.o spill.o workpool.o
+ *   g++ -std=c++17 app.cc libpoly.a -pthread
+ *
+ * Example:
+ *
+ *   PolyCompileResult r = compile_poly_section("POLY F(x,y) = x^2 + y;");
+ *   if (r.polys) {
+ *       int value;
+ *       r.polys->evaluate("F", {3, 4}, value);   // value == 13
+ *   }
+ */
+#ifndef __POLYLIB__H__
+#define __POLYLIB__H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "parser.h"
+#include "evalplan.h"
+
+enum PolyErrorKind { POLY_NO_ERROR, POLY_SYNTAX_ERROR, POLY_SEMANTIC_ERROR };
+
+struct PolyError {
+    PolyErrorKind kind;
+    std::string code;        // "DMT-12" or "IM-4" for semantic errors
+    std::vector<int> lines;  // sorted line numbers for semantic errors
+    std::string message;     // the text the command line compiler would print
+
+    PolyError() : kind(POLY_NO_ERROR) {}
+};
+
+enum PolyEvalStatus { EVAL_OK, EVAL_UNKNOWN_POLY, EVAL_WRONG_ARG_COUNT };
+
+class CompiledPolys {
+  public:
+    // Also builds the Task 2 state of the declarations: their evaluation
+    // plans (options.cse_plans) and the JIT (options.jit_threshold)
+    explicit CompiledPolys(DeclStore decls, const ParserOptions& options = ParserOptions());
+
+    // Index of the polynomial called `name`, or -1 if it is not declared
+    int find(const std::string& name) const { return decls.find(name); }
+    int size() const { return decls.size(); }
+    const RichPolyDecl& decl(int index) const { return decls[index]; }
+    const EvalState& eval_state() const { return state; }
+
+    // Evaluation is read-only and may be called concurrently
+    PolyEvalStatus evaluate(const std::string& name, const std::vector<int>& args, int& result) const;
+    PolyEvalStatus evaluate(int index, const std::vector<int>& args, int& result) const;
+
+  private:
+    DeclStore decls;
+    EvalState state;
+};
+
+struct PolyCompileResult {
+    std::shared_ptr<const CompiledPolys> polys;  // null if there was an error
+    PolyError error;
+};
+
+// `source` is a POLY section: the keyword POLY followed by declarations
+PolyCompileResult compile_poly_section(const std::string& source,
+                                       const ParserOptions& options = ParserOptions());
+PolyCompileResult compile_poly_section(const char* data, size_t size,
+                                       const ParserOptions& options = ParserOptions());
+
+#endif  //__POLYLIB__H__
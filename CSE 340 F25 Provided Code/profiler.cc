@@ -0,0 +1,101 @@
+/*
+ * Profiler of Task 2, see profiler.h
+ */
+#include <algorithm>
+#include <iomanip>
+
+#include "profiler.h"
+
+using namespace std;
+
+static uint64_t elapsed_ns(Profiler::Clock::time_point since)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(Profiler::Clock::now() - since).count();
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return total > 0 ? 100.0 * part / total : 0;
+}
+
+Profiler::Profiler(int decl_count, int statement_count)
+    : start(Clock::now()), decls(decl_count), statement_ns(statement_count, 0)
+{
+}
+
+void Profiler::enter(int handle)
+{
+    if (handle < 0 || handle >= (int)decls.size()) {
+        handle = -1;
+    } else {
+        decls[handle].calls++;
+        decls[handle].active++;
+    }
+    frames.push_back(Frame{handle, Clock::now(), 0});
+}
+
+void Profiler::leave()
+{
+    Frame frame = frames.back();
+    frames.pop_back();
+    uint64_t elapsed = elapsed_ns(frame.start);
+    if (frame.handle >= 0) {
+        DeclProfile& decl = decls[frame.handle];
+        decl.self_ns += elapsed - min(frame.nested_ns, elapsed);
+        if (--decl.active == 0) {
+            decl.cumulative_ns += elapsed;
+        }
+    }
+    if (!frames.empty()) {
+        frames.back().nested_ns += elapsed;
+    }
+}
+
+void Profiler::end_statement(int index)
+{
+    statement_ns[index] += elapsed_ns(statement_start);
+}
+
+void Profiler::report(ostream& out, const vector<ProfileLabel>& decl_labels,
+                      const vector<ProfileLabel>& statement_labels) const
+{
+    uint64_t total_ns = elapsed_ns(start);
+    uint64_t calls = 0;
+    for (const DeclProfile& decl : decls) {
+        calls += decl.calls;
+    }
+    out << fixed << setprecision(3);
+    out << "profile: task 2 ms=" << total_ns / 1e6 << " statements=" << statement_ns.size()
+        << " calls=" << calls << endl;
+
+    vector<int> order;
+    for (int i = 0; i < (int)decls.size(); i++) {
+        if (decls[i].calls > 0) {
+            order.push_back(i);
+        }
+    }
+    stable_sort(order.begin(), order.end(), [this](int a, int b) { return decls[a].self_ns > decls[b].self_ns; });
+    out << "profile: " << left << setw(20) << "declaration" << right << setw(8) << "line"
+        << setw(12) << "calls" << setw(16) << "cumulative-ms" << setw(12) << "self-ms" << setw(8) << "self-%" << endl;
+    for (int i : order) {
+        const DeclProfile& decl = decls[i];
+        out << "profile: " << left << setw(20) << decl_labels[i].text << right << setw(8) << decl_labels[i].line
+            << setw(12) << decl.calls << setw(16) << decl.cumulative_ns / 1e6 << setw(12) << decl.self_ns / 1e6
+            << setw(8) << setprecision(1) << percent(decl.self_ns, total_ns) << setprecision(3) << endl;
+    }
+
+    order.clear();
+    for (int i = 0; i < (int)statement_ns.size(); i++) {
+        order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(), [this](int a, int b) { return statement_ns[a] > statement_ns[b]; });
+    order.resize(min<size_t>(order.size(), PROFILE_TOP_STATEMENTS));
+    out << "profile: " << left << setw(20) << "statement" << right << setw(8) << "line"
+        << setw(12) << "ms" << setw(8) << "%" << endl;
+    for (int i : order) {
+        out << "profile: " << left << setw(20) << statement_labels[i].text << right << setw(8)
+            << statement_labels[i].line << setw(12) << statement_ns[i] / 1e6
+            << setw(8) << setprecision(1) << percent(statement_ns[i], total_ns) << setprecision(3) << endl;
+    }
+    out << defaultfloat << setprecision(6);
+}
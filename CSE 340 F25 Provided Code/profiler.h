@@ -0,0 +1,68 @@
+/*
+ * Profiler of Task 2 (--profile): calls, cumulative and self time of every
+ * declaration and time of every statement
+ *
+ * The parser calls enter()/leave() around every polynomial call, nested
+ * calls made while evaluating arguments included, and
+ * start_statement()/end_statement() around every statement. The calls only
+ * happen when the parser has a Profiler, so when profiling is off the cost
+ * is one test of a null pointer per call and per statement.
+ */
+#ifndef __PROFILER__H__
+#define __PROFILER__H__
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Statements listed in the report; declarations are all listed
+#define PROFILE_TOP_STATEMENTS 20
+
+// What the report shows for a declaration or statement
+struct ProfileLabel {
+    std::string text;
+    int line;
+};
+
+class Profiler {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler(int decl_count, int statement_count);
+
+    // Start and end of a call of the declaration with this handle (-1 or
+    // any other invalid handle for a call that evaluates nothing)
+    void enter(int handle);
+    void leave();
+
+    void start_statement() { statement_start = Clock::now(); }
+    void end_statement(int index);
+
+    // Sorted report: declarations by self time, then the statements that
+    // took the most time
+    void report(std::ostream& out, const std::vector<ProfileLabel>& decls,
+                const std::vector<ProfileLabel>& statements) const;
+
+  private:
+    struct DeclProfile {
+        uint64_t calls = 0;
+        uint64_t cumulative_ns = 0;  // outermost calls only, so recursion through arguments counts once
+        uint64_t self_ns = 0;        // excluding the nested calls
+        int active = 0;              // calls in progress
+    };
+    struct Frame {
+        int handle;
+        Clock::time_point start;
+        uint64_t nested_ns;          // time of the calls made by this one
+    };
+
+    Clock::time_point start;
+    Clock::time_point statement_start;
+    std::vector<DeclProfile> decls;
+    std::vector<uint64_t> statement_ns;
+    std::vector<Frame> frames;
+};
+
+#endif  //__PROFILER__H__
@@ -0,0 +1,256 @@
+/*
+ * Server mode, see server.h
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <random>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "parser.h"
+#include "polylib.h"
+
+using namespace std;
+
+// Latencies kept for the percentiles; once there are more requests, a
+// uniform random sample of them (reservoir sampling) is kept
+#define LATENCY_RESERVOIR_SIZE 4096
+
+// Request latencies in microseconds (parse + semantic check + execution).
+// Count, mean and maximum are exact; percentiles come from the reservoir.
+class LatencyStats {
+  public:
+    LatencyStats() : count(0), total(0), maximum(0) {}
+
+    void add(double micros)
+    {
+        count++;
+        total += micros;
+        maximum = max(maximum, micros);
+        if (samples.size() < LATENCY_RESERVOIR_SIZE) {
+            samples.push_back(micros);
+        } else {
+            uint64_t slot = uniform_int_distribution<uint64_t>(0, count - 1)(random);
+            if (slot < LATENCY_RESERVOIR_SIZE) {
+                samples[slot] = micros;
+            }
+        }
+    }
+
+    string summary() const
+    {
+        ostringstream s;
+        s << "requests " << count;
+        if (count > 0) {
+            vector<double> sorted = samples;
+            sort(sorted.begin(), sorted.end());
+            s << " mean_us " << total / count
+              << " p50_us " << percentile(sorted, 50)
+              << " p95_us " << percentile(sorted, 95)
+              << " p99_us " << percentile(sorted, 99)
+              << " max_us " << maximum;
+        }
+        s << "\n";
+        return s.str();
+    }
+
+  private:
+    uint64_t count;
+    double total;
+    double maximum;
+    vector<double> samples;
+    mt19937_64 random;
+
+    static double percentile(const vector<double>& sorted, int p)
+    {
+        size_t index = (sorted.size() - 1) * p / 100;
+        return sorted[index];
+    }
+};
+
+static bool read_all(int fd, char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+enum FrameStatus { FRAME_OK, FRAME_END, FRAME_BAD };
+
+// frame → NUM '\n' bytes, with NUM at most SERVER_MAX_FRAME
+static FrameStatus read_frame(int fd, string& frame)
+{
+    string header;
+    char c;
+    while (true) {
+        if (read(fd, &c, 1) != 1) return header.empty() ? FRAME_END : FRAME_BAD;
+        if (c == '\n') break;
+        if (c < '0' || c > '9' || header.size() > 18) return FRAME_BAD;
+        header += c;
+    }
+    if (header.empty()) return FRAME_BAD;
+
+    unsigned long long size = stoull(header);
+    if (size > SERVER_MAX_FRAME) return FRAME_BAD;
+    frame.resize(size);
+    return read_all(fd, &frame[0], frame.size()) ? FRAME_OK : FRAME_END;
+}
+
+static bool write_frame(int fd, const string& frame)
+{
+    string header = to_string(frame.size()) + "\n";
+    return write_all(fd, header.data(), header.size()) &&
+           write_all(fd, frame.data(), frame.size());
+}
+
+static bool is_stats_request(const string& request)
+{
+    size_t first = request.find_first_not_of(" \t\r\n");
+    size_t last = request.find_last_not_of(" \t\r\n");
+    return first != string::npos && request.compare(first, last - first + 1, "STATS") == 0;
+}
+
+static void serve(int in_fd, int out_fd, const CompiledPolys& polys,
+                  const ParserOptions& options, LatencyStats& stats)
+{
+    istringstream no_input;
+    ostringstream no_output;
+    Parser parser(no_input, no_output);
+    parser.set_options(options);
+    parser.use_resident_polys(&polys);
+
+    string request;
+    FrameStatus status;
+    while ((status = read_frame(in_fd, request)) == FRAME_OK) {
+        if (is_stats_request(request)) {
+            if (!write_frame(out_fd, stats.summary())) return;
+            continue;
+        }
+
+        auto start = chrono::steady_clock::now();
+        istringstream in(request);
+        ostringstream out;
+        parser.reset(in, out);
+        parser.parse_request();
+        chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+        stats.add(elapsed.count());
+
+        if (!write_frame(out_fd, out.str())) return;
+    }
+    if (status == FRAME_BAD) {
+        // The rest of the stream cannot be framed; only this connection ends
+        write_frame(out_fd, "ERROR bad frame header (at most " + to_string(SERVER_MAX_FRAME) + " bytes)\n");
+        cerr << "server: bad frame header, closing the connection\n";
+    }
+}
+
+static int serve_socket(const string& socket_path, const CompiledPolys& polys,
+                        const ParserOptions& options)
+{
+    sockaddr_un addr;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "server: socket path too long\n";
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("server: socket");
+        return 1;
+    }
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+        perror("server: bind");
+        close(listen_fd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // a client that goes away only ends its connection
+
+    LatencyStats stats;
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("server: accept");
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // Out of descriptors or memory for now: wait for some to be released
+                this_thread::sleep_for(chrono::milliseconds(SERVER_ACCEPT_BACKOFF_MS));
+                continue;
+            }
+            close(listen_fd);
+            return 1;
+        }
+        serve(fd, fd, polys, options, stats);
+        close(fd);
+        cerr << "server: " << stats.summary();
+    }
+}
+
+int run_server(const string& poly_file, const string& socket_path, const ParserOptions& options)
+{
+    ifstream file(poly_file);
+    if (!file) {
+        cerr << "server: cannot open " << poly_file << "\n";
+        return 1;
+    }
+    stringstream source;
+    source << file.rdbuf();
+
+    auto start = chrono::steady_clock::now();
+    PolyCompileResult compiled = compile_poly_section(source.str(), options);
+    if (!compiled.polys) {
+        cerr << poly_file << ": " << compiled.error.message;
+        return 1;
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    cerr << "server: loaded " << compiled.polys->size() << " polynomials in "
+         << elapsed.count() << " ms\n";
+    if (options.print_stats) {
+        const EvalState& state = compiled.polys->eval_state();
+        cerr << "stats: cse planned=" << state.planned << " used=" << state.used
+             << " multiplications=" << state.multiplications
+             << " naive-multiplications=" << state.naive_multiplications << endl;
+    }
+
+    if (!socket_path.empty()) {
+        return serve_socket(socket_path, *compiled.polys, options);
+    }
+
+    LatencyStats stats;
+    serve(0, 1, *compiled.polys, options, stats);
+    cerr << "server: " << stats.summary();
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Server mode: keeps a POLY section resident and runs EXECUTE/INPUTS
+ * requests against it
+ */
+#ifndef __SERVER__H__
+#define __SERVER__H__
+
+#include <string>
+
+#include "parser.h"
+
+#define SERVER_MAX_FRAME (256ull << 20)  // bytes of one request frame
+#define SERVER_ACCEPT_BACKOFF_MS 100     // wait after accept() runs out of descriptors
+
+// Compiles the POLY section in poly_file once and then answers requests.
+// Requests and responses are framed as a decimal byte count on a line of
+// its own followed by that many bytes. A request is an EXECUTE section
+// followed by an INPUTS section and the response is what Task 2 prints (or
+// the syntax/semantic error message). The request "STATS" returns latency
+// metrics instead. A frame longer than SERVER_MAX_FRAME bytes, or whose
+// header is not a decimal number, gets an "ERROR ..." response and ends
+// the connection (the server itself keeps running).
+//
+// With an empty socket_path requests are read from stdin and responses are
+// written to stdout until end of input. Otherwise the server listens on the
+// Unix domain socket and serves connections one after another.
+int run_server(const std::string& poly_file, const std::string& socket_path,
+               const ParserOptions& options);
+
+#endif  //__SERVER__H__
@@ -0,0 +1,194 @@
+/*
+ * Bounded-memory accumulation of expanded terms, see spill.h
+ */
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "spill.h"
+
+using namespace std;
+
+// Runs merged at once; more runs are first merged into intermediate runs
+#define MAX_MERGE_FAN_IN 64
+
+TermSpiller::TermSpiller(int param_count, size_t memory_budget)
+    : stride(param_count + 1), runs_written_(0)
+{
+    // Each record also needs an index while the buffer is sorted
+    size_t record_bytes = stride * sizeof(int32_t) + sizeof(uint32_t);
+    capacity = max<size_t>(memory_budget / record_bytes, 16);
+}
+
+TermSpiller::~TermSpiller()
+{
+    for (FILE* run : runs) {
+        fclose(run);
+    }
+}
+
+bool TermSpiller::record_before(const int32_t* a, const int32_t* b) const
+{
+    int degree_a = 0, degree_b = 0;
+    for (int i = 1; i < stride; i++) {
+        degree_a += a[i];
+        degree_b += b[i];
+    }
+    if (degree_a != degree_b) {
+        return degree_a > degree_b;
+    }
+    for (int i = 1; i < stride; i++) {
+        if (a[i] != b[i]) {
+            return a[i] > b[i];
+        }
+    }
+    return false;
+}
+
+void TermSpiller::add(int coefficient, const int* exponents)
+{
+    buffer.push_back(coefficient);
+    buffer.insert(buffer.end(), exponents, exponents + stride - 1);
+
+    if (record_count() >= capacity) {
+        compact();
+        if (record_count() > capacity / 2) {
+            spill(); // if there is no room on disk, keep going in memory
+        }
+    }
+}
+
+// Sorts the buffer and combines identical monomials, dropping zero terms
+void TermSpiller::compact()
+{
+    size_t count = record_count();
+    vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; i++) order[i] = i;
+    sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return record_before(&buffer[a * stride], &buffer[b * stride]);
+    });
+
+    vector<int32_t> combined;
+    combined.reserve(buffer.size());
+    size_t i = 0;
+    while (i < count) {
+        const int32_t* first = &buffer[order[i] * stride];
+        int coefficient = first[0];
+        size_t j = i + 1;
+        while (j < count && equal(first + 1, first + stride, &buffer[order[j] * stride + 1])) {
+            coefficient += buffer[order[j] * stride];
+            j++;
+        }
+        if (coefficient != 0) {
+            combined.push_back(coefficient);
+            combined.insert(combined.end(), first + 1, first + stride);
+        }
+        i = j;
+    }
+    buffer.swap(combined);
+}
+
+// Writes the buffer as a run; on failure the buffer is left as it is
+bool TermSpiller::spill()
+{
+    FILE* run = tmpfile();
+    if (!run) {
+        return false;
+    }
+    if (fwrite(buffer.data(), sizeof(int32_t), buffer.size(), run) != buffer.size() || fflush(run) != 0) {
+        fclose(run);
+        return false;
+    }
+    rewind(run);
+    runs.push_back(run);
+    runs_written_++;
+    buffer.clear();
+    return true;
+}
+
+bool TermSpiller::finish(const EmitFunction& emit)
+{
+    compact();
+    if (runs.empty()) {
+        for (size_t i = 0; i < buffer.size(); i += stride) {
+            emit(buffer[i], &buffer[i + 1]);
+        }
+        buffer.clear();
+        return true;
+    }
+
+    if (!buffer.empty() && !spill()) {
+        return false;
+    }
+    vector<int32_t>().swap(buffer);
+
+    // Reduce the number of runs until they can be merged in one pass. If
+    // no file can be opened for an intermediate run, all of them are
+    // merged at once instead.
+    while (runs.size() > MAX_MERGE_FAN_IN) {
+        FILE* merged = tmpfile();
+        if (!merged) break;
+        vector<FILE*> group(runs.begin(), runs.begin() + MAX_MERGE_FAN_IN);
+        runs.erase(runs.begin(), runs.begin() + MAX_MERGE_FAN_IN);
+        bool written = true;
+        bool read = merge(group, [this, merged, &written](int coefficient, const int* exponents) {
+            written = written && fwrite(&coefficient, sizeof(int32_t), 1, merged) == 1 &&
+                      fwrite(exponents, sizeof(int32_t), stride - 1, merged) == (size_t)(stride - 1);
+        });
+        if (!read || !written || fflush(merged) != 0) {
+            fclose(merged);
+            return false;
+        }
+        rewind(merged);
+        runs.push_back(merged);
+        runs_written_++;
+    }
+
+    return merge(runs, emit);
+}
+
+// k-way merge of sorted runs; closes the inputs. Returns false if one of
+// them could not be read to the end.
+bool TermSpiller::merge(vector<FILE*>& inputs, const EmitFunction& emit)
+{
+    size_t k = inputs.size();
+    vector<int32_t> heads(k * stride);
+    auto read_head = [&](size_t run) {
+        return fread(&heads[run * stride], sizeof(int32_t), stride, inputs[run]) == (size_t)stride;
+    };
+    auto later = [&](size_t a, size_t b) {
+        return record_before(&heads[b * stride], &heads[a * stride]);
+    };
+    priority_queue<size_t, vector<size_t>, decltype(later)> queue(later);
+    for (size_t run = 0; run < k; run++) {
+        if (read_head(run)) queue.push(run);
+    }
+
+    vector<int32_t> current(stride);
+    while (!queue.empty()) {
+        size_t run = queue.top();
+        queue.pop();
+        copy(&heads[run * stride], &heads[run * stride] + stride, current.begin());
+        if (read_head(run)) queue.push(run);
+
+        // Combine the same monomial coming from other runs
+        while (!queue.empty() &&
+               equal(current.begin() + 1, current.end(), &heads[queue.top() * stride + 1])) {
+            size_t other = queue.top();
+            queue.pop();
+            current[0] += heads[other * stride];
+            if (read_head(other)) queue.push(other);
+        }
+        if (current[0] != 0) {
+            emit(current[0], &current[1]);
+        }
+    }
+
+    bool complete = true;
+    for (FILE* input : inputs) {
+        complete = complete && !ferror(input);
+        fclose(input);
+    }
+    inputs.clear();
+    return complete;
+}
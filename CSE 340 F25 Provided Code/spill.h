@@ -0,0 +1,54 @@
+/*
+ * Bounded-memory accumulation of expanded terms for Task 5
+ */
+#ifndef __SPILL__H__
+#define __SPILL__H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+// Collects the terms of one expanded polynomial without ever holding more
+// than about memory_budget bytes of them. Terms are stored as records
+// [coefficient, e_0, ..., e_{n-1}]. When the buffer fills up it is sorted
+// and identical monomials are combined; if that does not free at least half
+// of the buffer, it is written to a temporary file as a sorted run.
+// finish() k-way merges the runs and passes every distinct monomial with a
+// non-zero coefficient to `emit`, in Task 5 order (degree descending, then
+// exponents descending in parameter order).
+//
+// If a run cannot be written while terms are added, they stay in memory.
+// finish() returns false if a temporary file cannot be written, in which
+// case nothing has been emitted, or cannot be read back, in which case the
+// terms emitted are incomplete.
+class TermSpiller {
+  public:
+    typedef std::function<void(int coefficient, const int* exponents)> EmitFunction;
+
+    TermSpiller(int param_count, size_t memory_budget);
+    ~TermSpiller();
+    TermSpiller(const TermSpiller&) = delete;
+    TermSpiller& operator=(const TermSpiller&) = delete;
+
+    void add(int coefficient, const int* exponents);
+    bool finish(const EmitFunction& emit);
+
+    int runs_written() const { return runs_written_; }
+
+  private:
+    int stride;               // ints per record
+    size_t capacity;          // records that fit in the budget
+    std::vector<int32_t> buffer;
+    std::vector<FILE*> runs;
+    int runs_written_;
+
+    size_t record_count() const { return buffer.size() / stride; }
+    bool record_before(const int32_t* a, const int32_t* b) const;
+    void compact();
+    bool spill();
+    bool merge(std::vector<FILE*>& inputs, const EmitFunction& emit);
+};
+
+#endif  //__SPILL__H__
@@ -1,4 +1,16 @@
 #!/bin/bash
+#
+# Runs every provided_tests/*/NAME.txt through ./a.out and compares what it
+# prints with NAME.txt.expected. Two optional files go with a test:
+#
+#   NAME.txt.args              arguments for a.out; paths are relative to
+#                              this directory, and ./output is a scratch
+#                              directory that exists for the whole run
+#   NAME.txt.stderr.expected   what a.out must print on standard error
+#
+# A test also fails if standard error contains a sanitizer report, so an
+# a.out built with -fsanitize=address,undefined checks every test for
+# leaks and undefined behavior.
 
 if [ ! -d "./provided_tests" ]; then
     echo "Error: tests directory not found!"
@@ -20,13 +32,33 @@ let all=0
 
 mkdir -p ./output
 
+# Appends problems with a.out's standard error to the diff; fails if any
+check_stderr() {
+    ok=0
+    if grep -q "Sanitizer\|runtime error:" ${error_file}; then
+        cat ${error_file} >> ${diff_file}
+        ok=1
+    fi
+    if [ -f ${test_file}.stderr.expected ]; then
+        if ! diff -Bw ${test_file}.stderr.expected ${error_file} >> ${diff_file}; then
+            ok=1
+        fi
+    fi
+    return $ok
+}
+
 for test_file in $(find ./provided_tests -type f -name "*.txt" | sort); do
     all=$((all+1))
     name=`basename ${test_file} .txt`
     expected_file=${test_file}.expected
     output_file=./output/${name}.output
+    error_file=./output/${name}.stderr
     diff_file=./output/${name}.diff
-    ./a.out < ${test_file} > ${output_file}
+    args=""
+    if [ -f ${test_file}.args ]; then
+        args=$(<${test_file}.args)
+    fi
+    ./a.out ${args} < ${test_file} > ${output_file} 2> ${error_file}
 
 
     folder_name="$(cut -d'/' -f3 <<<"${test_file}")"
@@ -38,7 +70,7 @@ for test_file in $(find ./provided_tests -type f -name "*.txt" | sort); do
 		exp=$(<${expected_file})
 
 		if [[ ${exp} == "SYNTAX ERROR !!!!!&%!!" ]]; then
-			if [[ ${out} == "SYNTAX ERROR !!!!!&%!!" ]]; then
+			if [[ ${out} == "SYNTAX ERROR !!!!!&%!!" ]] && check_stderr; then
 				count=$((count+1))
 				echo "${folder_name}/${name}: OK"
 			else
@@ -47,7 +79,7 @@ for test_file in $(find ./provided_tests -type f -name "*.txt" | sort); do
 				cat ${diff_file}
 			fi
 		else
-			if [[ ${out} == "SYNTAX ERROR !!!!!&%!!" ]]; then
+			if [[ ${out} == "SYNTAX ERROR !!!!!&%!!" ]] || ! check_stderr; then
 				echo "${folder_name}/${name}: Output does not match expected:"
 				echo "--------------------------------------------------------"
 				cat ${diff_file}
@@ -61,6 +93,7 @@ for test_file in $(find ./provided_tests -type f -name "*.txt" | sort); do
 
 
 	    diff -Bw ${expected_file} ${output_file} > ${diff_file}
+	    check_stderr
 		
 	    echo
 	    if [ -s ${diff_file} ]; then
@@ -74,6 +107,7 @@ for test_file in $(find ./provided_tests -type f -name "*.txt" | sort); do
     fi
     echo "========================================================"
     rm -f ${output_file}
+    rm -f ${error_file}
     rm -f ${diff_file}
 done
 
@@ -81,4 +115,5 @@ echo
 echo "Passed $count tests out of $all"
 echo
 
-rmdir ./output
+# Tests may leave files in ./output (see NAME.txt.args above)
+rm -rf ./output
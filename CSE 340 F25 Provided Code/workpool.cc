@@ -0,0 +1,101 @@
+/*
+ * Work-stealing execution of a dependency graph
+ */
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "workpool.h"
+
+using namespace std;
+
+int TaskGraph::add_node()
+{
+    successors.emplace_back();
+    dependencies.push_back(0);
+    return size() - 1;
+}
+
+void TaskGraph::add_edge(int from, int to)
+{
+    successors[from].push_back(to);
+    dependencies[to]++;
+}
+
+namespace {
+
+struct WorkerQueue {
+    mutex lock;
+    deque<int> nodes;
+};
+
+}
+
+void WorkStealingPool::run(const TaskGraph& graph, const function<void(int)>& work)
+{
+    int node_count = graph.size();
+    unique_ptr<atomic<int>[]> pending(new atomic<int>[node_count]);
+    vector<WorkerQueue> queues(threads);
+    atomic<int> remaining(node_count);
+    atomic<uint64_t> steals(0);
+
+    // Nodes without dependencies are dealt out round-robin
+    int next_queue = 0;
+    for (int node = 0; node < node_count; node++) {
+        pending[node].store(graph.dependencies[node], memory_order_relaxed);
+        if (graph.dependencies[node] == 0) {
+            queues[next_queue].nodes.push_back(node);
+            next_queue = (next_queue + 1) % threads;
+        }
+    }
+
+    auto worker = [&](int self) {
+        WorkerQueue& own = queues[self];
+        while (remaining.load(memory_order_acquire) > 0) {
+            int node = -1;
+            {
+                lock_guard<mutex> guard(own.lock);
+                if (!own.nodes.empty()) {
+                    node = own.nodes.back();
+                    own.nodes.pop_back();
+                }
+            }
+            for (int i = 1; node < 0 && i < threads; i++) {
+                WorkerQueue& victim = queues[(self + i) % threads];
+                lock_guard<mutex> guard(victim.lock);
+                if (!victim.nodes.empty()) {
+                    node = victim.nodes.front();
+                    victim.nodes.pop_front();
+                    steals.fetch_add(1, memory_order_relaxed);
+                }
+            }
+            if (node < 0) {
+                this_thread::yield();
+                continue;
+            }
+
+            work(node);
+
+            for (int successor : graph.successors[node]) {
+                // acq_rel: the last predecessor to finish sees what all the others wrote
+                if (pending[successor].fetch_sub(1, memory_order_acq_rel) == 1) {
+                    lock_guard<mutex> guard(own.lock);
+                    own.nodes.push_back(successor);
+                }
+            }
+            remaining.fetch_sub(1, memory_order_release);
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (thread& t : workers) {
+        t.join();
+    }
+    steal_count = steals.load();
+}
@@ -0,0 +1,39 @@
+/*
+ * Work-stealing execution of a dependency graph
+ */
+#ifndef __WORKPOOL__H__
+#define __WORKPOOL__H__
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Nodes 0..size()-1 with the edges between them. An edge from a to b means
+// b may only run after a has finished.
+struct TaskGraph {
+    std::vector<std::vector<int>> successors;  // by node
+    std::vector<int> dependencies;             // number of edges into each node
+
+    int add_node();
+    void add_edge(int from, int to);
+    int size() const { return (int)successors.size(); }
+};
+
+// Runs every node of a graph once, with `work(node)`, on a fixed number of
+// threads (the calling thread is one of them). Each worker keeps the nodes
+// it made ready in its own deque and runs the newest first; a worker whose
+// deque is empty steals the oldest node of another worker. Everything the
+// work of a node wrote is visible to the work of its successors.
+class WorkStealingPool {
+  public:
+    explicit WorkStealingPool(int threads) : threads(threads < 1 ? 1 : threads), steal_count(0) {}
+
+    void run(const TaskGraph& graph, const std::function<void(int)>& work);
+    uint64_t steals() const { return steal_count; }  // of the last run()
+
+  private:
+    int threads;
+    uint64_t steal_count;
+};
+
+#endif  //__WORKPOOL__H__